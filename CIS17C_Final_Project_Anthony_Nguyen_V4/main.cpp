@@ -1,595 +1,3424 @@
 #include <iostream>
 #include <vector>
-#include <map>
+#include <array>
 #include <string>
 #include <algorithm>
+#include <cstdint>
+#include <cctype>
+#include <sstream>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <iomanip>
+#include <fstream>
+#include <cstring>
+#include <cmath>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define HAS_SIMD_SUPPORT 1
+#endif
+
+// PEXT indexing is only compiled into builds made for BMI2 CPUs (-mbmi2 or -march=native), where it is
+// inlined into every sliding attack lookup
+#if defined(__BMI2__)
+#define HAS_PEXT_SUPPORT 1
+#endif
 
 using namespace std;
 
 // Constants
 const int BOARD_SIZE = 8;
+const int NUM_SQUARES = 64;
+const int NO_SQUARE = -1;
+const string START_FEN = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
 
 // Piece types
-enum class PieceType { KING, QUEEN, ROOK, BISHOP, KNIGHT, PAWN, NONE };
+enum class PieceType : uint8_t { KING, QUEEN, ROOK, BISHOP, KNIGHT, PAWN, NONE };
 
 // Piece colors
-enum class PieceColor { WHITE, BLACK, NONE };
+enum class PieceColor : uint8_t { WHITE, BLACK, NONE };
 
-// Define piece structure
+// Function to pack a piece type and color into one byte: the type in bits 0-2, the color in bits 3-4
+constexpr uint8_t packPiece(PieceType type, PieceColor color) {
+    return static_cast<uint8_t>(static_cast<int>(type) | (static_cast<int>(color) << 3));
+}
+
+// Packed value of an empty square
+const uint8_t NO_PIECE = packPiece(PieceType::NONE, PieceColor::NONE);
+
+// Define piece structure, packed into a single byte
 struct Piece {
-    PieceType type = PieceType::NONE;
-    PieceColor color = PieceColor::NONE;
-    bool moved = false; // For tracking pawn moves and castling eligibility
+    uint8_t packed = NO_PIECE;
+    PieceType type() const { return static_cast<PieceType>(packed & 7); }
+    PieceColor color() const { return static_cast<PieceColor>(packed >> 3); }
+};
+static_assert(sizeof(Piece) == 1, "Piece must stay packed into one byte");
+
+// Bitboard: one bit per square, a1 = bit 0, b1 = bit 1, ..., h8 = bit 63
+typedef uint64_t Bitboard;
+
+const Bitboard FILE_A_BB = 0x0101010101010101ULL;
+const Bitboard FILE_H_BB = FILE_A_BB << 7;
+const Bitboard RANK_1_BB = 0xFFULL;
+const Bitboard RANK_3_BB = RANK_1_BB << 16;
+const Bitboard RANK_6_BB = RANK_1_BB << 40;
+const Bitboard RANK_8_BB = RANK_1_BB << 56;
+
+// Castling rights flags
+const int WHITE_KINGSIDE = 1;
+const int WHITE_QUEENSIDE = 2;
+const int BLACK_KINGSIDE = 4;
+const int BLACK_QUEENSIDE = 8;
+const int ALL_CASTLING = WHITE_KINGSIDE | WHITE_QUEENSIDE | BLACK_KINGSIDE | BLACK_QUEENSIDE;
+
+// Move flags for the special moves
+enum class MoveFlag { NORMAL, PROMOTION, EN_PASSANT, CASTLING };
+
+// Define move structure, packed into 16 bits: from (6), to (6), promotion piece (2), flag (2).
+// All bits clear is the empty move, as no move starts and ends on the same square
+struct Move {
+    uint16_t packed = 0;
+    Move() = default;
+    explicit Move(uint16_t bits) : packed(bits) {}
+    Move(int from, int to, PieceType promotion, MoveFlag flag)
+        : packed(static_cast<uint16_t>(from | (to << 6) | (static_cast<int>(flag) << 14) |
+                 (flag == MoveFlag::PROMOTION ? (static_cast<int>(promotion) - static_cast<int>(PieceType::QUEEN)) << 12 : 0))) {}
+    int from() const { return packed & 63; }
+    int to() const { return (packed >> 6) & 63; }
+    MoveFlag flag() const { return static_cast<MoveFlag>(packed >> 14); }
+    PieceType promotion() const {
+        return flag() == MoveFlag::PROMOTION ? static_cast<PieceType>(static_cast<int>(PieceType::QUEEN) + ((packed >> 12) & 3))
+                                             : PieceType::NONE;
+    }
+    bool isNone() const { return packed == 0; }
+};
+static_assert(sizeof(Move) == 2, "Move must stay packed into two bytes");
+
+// Upper bound on the number of legal moves in a position (the most known is 218)
+const int MAX_MOVES = 256;
+
+// Define move list structure: a fixed-capacity list stored inline, so generating moves never allocates
+struct MoveList {
+    Move moves[MAX_MOVES];
+    int count = 0;
+    void push_back(const Move& move) { moves[count++] = move; }
+    void clear() { count = 0; }
+    int size() const { return count; }
+    bool empty() const { return count == 0; }
+    Move& operator[](int i) { return moves[i]; }
+    const Move& operator[](int i) const { return moves[i]; }
+    Move* begin() { return moves; }
+    Move* end() { return moves + count; }
+    const Move* begin() const { return moves; }
+    const Move* end() const { return moves + count; }
+};
+
+// Zobrist hash key identifying a position
+typedef uint64_t Key;
+
+// Irreversible state saved by doMove so that undoMove can restore it
+struct StateInfo {
+    Move move;                            // Move that led away from this state
+    PieceType captured;                   // Piece type captured by that move, NONE if none
+    int castlingRights;
+    int enPassantSquare;
+    int halfmoveClock;
+    Key key;
 };
 
-// Chessboard
-vector<vector<Piece>> board(BOARD_SIZE, vector<Piece>(BOARD_SIZE));
-
-// Map to convert piece type to symbol
-map<PieceType, string> pieceSymbols = {
-    {PieceType::KING, "K"},
-    {PieceType::QUEEN, "Q"},
-    {PieceType::ROOK, "R"},
-    {PieceType::BISHOP, "B"},
-    {PieceType::KNIGHT, "N"},
-    {PieceType::PAWN, "P"},
-    {PieceType::NONE, " "}
+// Maximum number of moves that can be undone
+const int MAX_STATE_STACK = 1024;
+
+// Search constants
+const int MAX_PLY = 128;                            // Deepest ply the search can reach
+const int INFINITE_SCORE = 32000;
+const int MATE_SCORE = 31000;                       // Mate at the root, mate in N plies scores MATE_SCORE - N
+const int MATE_BOUND = MATE_SCORE - MAX_PLY;        // Scores beyond this are mate scores
+const int DEFAULT_MOVE_TIME_MS = 1000;
+const int MOVE_OVERHEAD_MS = 10;                    // Time kept back for the move to reach the clock
+const int DEFAULT_MOVES_TO_GO = 30;                 // Moves assumed left when the clock has no moves-to-go
+
+// NNUE network shape: one input per color, piece type and square, a hidden layer seen from each side,
+// and the quantization of the first layer (QA) and the output layer (QB)
+const int NNUE_INPUTS = 2 * 6 * 64;
+const int NNUE_HIDDEN = 256;
+const int NNUE_QA = 255;
+const int NNUE_QB = 64;
+const int NNUE_SCALE = 400;                         // Centipawns per unit of network output
+
+// Function to get a mailbox with every square empty
+inline array<uint8_t, NUM_SQUARES> emptyMailbox() {
+    array<uint8_t, NUM_SQUARES> squares;
+    squares.fill(NO_PIECE);
+    return squares;
+}
+
+// Define position structure: a mailbox giving the packed piece on each square, which fills the first
+// cache line, then one bitboard per color and piece type plus occupancy sets. The undo information and
+// NNUE accumulators live in a StateStack beside it, so that a stored position stays small
+struct Position {
+    alignas(64) array<uint8_t, NUM_SQUARES> squares = emptyMailbox(); // Packed Piece on each square, kept in step with the bitboards
+    Bitboard pieces[2][6] = {};           // Squares holding each color's pieces, indexed by PieceType
+    Bitboard occupied[2] = {};            // Squares holding any piece of each color
+    Bitboard allPieces = 0;               // Squares holding any piece
+    PieceColor sideToMove = PieceColor::WHITE;
+    int castlingRights = 0;               // Combination of the castling rights flags
+    int enPassantSquare = NO_SQUARE;      // Square a pawn may capture onto en passant
+    int halfmoveClock = 0;                // Plies since the last capture or pawn move
+    int fullmoveNumber = 1;
+    Key key = 0;                          // Zobrist hash of everything above, kept up to date by doMove
+    int mgScore = 0;                      // Material and piece-square score from white's point of view,
+    int egScore = 0;                      // in the middlegame and in the endgame, kept up to date like the key
+    int phase = 0;                        // Game phase of the material left, from 0 (endgame) upwards
+    Key pawnKey = 0;                      // Zobrist hash of the pawns only, for the pawn hash table
+};
+static_assert(sizeof(Position) <= 256, "Position should fit in four cache lines");
+
+// Undo information of the moves made on a position plus its NNUE accumulators, both kept up to date by
+// doMove and undoMove. A game and each search thread keep one beside their position, set up for it by
+// resetStateStack
+struct StateStack {
+    StateInfo entries[MAX_STATE_STACK];   // Undo information, one entry per move made
+    int size = 0;
+    alignas(32) int16_t accumulator[2][NNUE_HIDDEN] = {}; // NNUE first layer seen from each color, without
+                                          // its bias, valid from refreshAccumulators on while NNUE is in use
+};
+
+// Bound of a score stored in the transposition table
+enum class Bound { NONE, UPPER, LOWER, EXACT };
+
+// Transposition table entry unpacked for the search
+struct TTData {
+    Move move;
+    int score = 0;
+    int depth = 0;
+    Bound bound = Bound::NONE;
 };
 
-// Map to convert algebraic notation to board coordinates
-map<char, int> colToIndex = {
-    {'a', 0}, {'b', 1}, {'c', 2}, {'d', 3},
-    {'e', 4}, {'f', 5}, {'g', 6}, {'h', 7}
+// Transposition table slot: two words, the first holding the key XORed with the second.
+// A slot torn by two threads writing at once fails the key check instead of returning bad data,
+// so no locks are needed. The data word holds, from the low bits: move (16), score (16),
+// depth (8), bound (2) and search generation (6)
+struct TTEntry {
+    atomic<uint64_t> keyXorData{0};
+    atomic<uint64_t> data{0};
 };
 
-// Function to initialize the chessboard
-void initializeBoard() {
-    // Clear the board
-    for (int i = 0; i < BOARD_SIZE; i++) {
-        for (int j = 0; j < BOARD_SIZE; j++) {
-            board[i][j] = {PieceType::NONE, PieceColor::NONE};
+// Entries per bucket, one bucket fills a 64-byte cache line
+const int TT_BUCKET_SIZE = 4;
+const int DEFAULT_HASH_MB = 16;
+
+struct alignas(64) TTBucket {
+    TTEntry entries[TT_BUCKET_SIZE];
+};
+
+// Define transposition table structure, shared by every search thread of every game
+struct TranspositionTable {
+    unique_ptr<TTBucket[]> buckets;
+    size_t bucketCount = 0;
+    atomic<uint8_t> generation{0}; // Advanced by every new search, which stamps its entries with the value it
+                                   // took so that old entries age out. Searches never write it afterwards
+};
+
+// Hash table for the AI search
+TranspositionTable transpositionTable;
+
+// Limits for one search, times in milliseconds
+struct SearchLimits {
+    int depth = MAX_PLY - 1;
+    int moveTime = 0;                     // Fixed time for this move, 0 for none
+    int timeLeft = 0;                     // Clock of the side to move, 0 for no clock
+    int increment = 0;                    // Time added to the clock after each move
+    int movesToGo = 0;                    // Moves until the next time control, 0 if the rest of the game
+};
+
+// Deadlines worked out from the limits, in milliseconds since the search started
+struct TimeManager {
+    int softLimit = 0;                    // Target time, scaled by best move stability; 0 for none
+    int hardLimit = 0;                    // The search is aborted here; 0 for none
+    bool fixedTime = false;               // A fixed move time always uses its full budget
+    Move lastBestMove;                    // Best move of the previous iteration
+    int lastScore = 0;
+    int bestMoveStability = 0;            // Iterations in a row that kept the same best move
+};
+
+// Counters of how often the pruning and reduction techniques of the search were applied
+struct SearchStats {
+    uint64_t nullMoveTries = 0;           // Null-move searches made
+    uint64_t nullMoveCutoffs = 0;         // Nodes pruned by them
+    uint64_t nullMoveVerifications = 0;   // Cutoffs checked by a reduced search of the real moves
+    uint64_t nullMoveVerifyFails = 0;     // Checks that did not confirm the cutoff
+    uint64_t lmrReductions = 0;           // Late moves searched at reduced depth
+    uint64_t lmrResearches = 0;           // Reduced moves that beat alpha and were searched again in full
+};
+
+// Define search result structure
+struct SearchResult {
+    Move bestMove;
+    int score = 0;
+    int depth = 0;                        // Deepest completed iteration
+    vector<Move> pv;                      // Principal variation, starting with the best move
+    uint64_t nodes = 0;
+    uint64_t pawnProbes = 0;              // Pawn hash table lookups of all threads, and how many hit
+    uint64_t pawnHits = 0;
+    SearchStats stats;                    // Sum of the counters of all threads
+};
+
+// Pawn structure score of one pawn placement, from white's point of view
+struct PawnEntry {
+    Key key;
+    int mgScore;
+    int egScore;
+};
+
+// Pawn hash table, one per search thread so that it needs no locking
+const int PAWN_TABLE_SIZE = 1 << 14;
+struct PawnTable {
+    PawnEntry entries[PAWN_TABLE_SIZE] = {};
+    atomic<uint64_t> probes{0};           // Written by the owning thread, read by thread 0 for reports
+    atomic<uint64_t> hits{0};
+};
+
+// State of one search thread: its own copy of the position plus the principal variation table.
+// Threads share only the transposition table and the stop flag. A worker is kept between searches,
+// so its pawn hash and history tables carry over from one move to the next
+struct SearchWorker {
+    int threadId = 0;                     // Thread 0 runs the clock and reports progress
+    Position pos;
+    StateStack states;                    // Undo information of the game and search moves leading to pos
+    uint8_t ttGeneration = 0;             // Generation this search stamps on its hash table entries
+    SearchLimits limits;
+    TimeManager time;                     // Used by thread 0 only
+    chrono::steady_clock::time_point startTime;
+    atomic<bool>* stop = nullptr;
+    bool verbose = false;                 // Print a line after every completed iteration
+    atomic<uint64_t> nodes{0};            // Written by this thread, read by thread 0 for reports
+    Move pvTable[MAX_PLY][MAX_PLY];       // pvTable[ply] holds the best line found from that ply
+    int pvLength[MAX_PLY];
+    Move killers[MAX_PLY][2];             // Two quiet moves per ply that caused beta cutoffs
+    int history[2][NUM_SQUARES][NUM_SQUARES] = {}; // Butterfly table: cutoff success of quiet moves by from/to
+    PawnTable pawnTable;
+    int nullMoveMinPly = 0;               // Null moves are off below this ply while a null-move cutoff is verified
+    SearchStats stats;
+    int completedDepth = 0;               // Result of the deepest completed iteration
+    int bestScore = 0;
+    vector<Move> pv;
+};
+
+// Search threads not in use, kept with their pawn hash and history tables for the next search of any game.
+// It holds as many workers as the most threads ever searching at once, however many games there are
+struct WorkerPool {
+    mutex lock;
+    vector<unique_ptr<SearchWorker>> idle;
+};
+WorkerPool workerPool;
+
+// AI settings, changed from the command line
+int aiMoveTime = DEFAULT_MOVE_TIME_MS;
+int aiDepth = MAX_PLY - 1;
+int searchThreads = 1;
+
+// AI time control, used instead of the fixed move time when a time is given
+int aiTimeControlTime = 0;                // Time at the start and added at each time control
+int aiIncrement = 0;
+int aiTimeControlMoves = 0;               // Moves per time control, 0 for the whole game
+
+// Define game structure: the position being played plus the moves that led to it and the AI's clock.
+// All of the game's state lives here, so several games can be played side by side
+struct Game {
+    Position pos;
+    StateStack states;                    // Undo information of the moves that can be taken back quickly
+    vector<Move> history;                 // Moves played from the starting position, oldest first
+    int aiTimeLeft = 0;                   // AI clock, 0 when it plays with a fixed move time
+    int aiMovesToGo = 0;                  // Moves left in the current time control
+};
+
+// Bitboard helpers
+constexpr Bitboard squareBB(int square) { return 1ULL << square; }
+inline int popCount(Bitboard b) { return __builtin_popcountll(b); }
+inline int lsb(Bitboard b) { return __builtin_ctzll(b); }
+inline int msb(Bitboard b) { return 63 - __builtin_clzll(b); }
+inline int popLsb(Bitboard& b) { int square = lsb(b); b &= b - 1; return square; }
+inline Bitboard shiftBB(Bitboard b, int delta) { return delta > 0 ? b << delta : b >> -delta; }
+
+// Square helpers
+constexpr int fileOf(int square) { return square & 7; }
+constexpr int rankOf(int square) { return square >> 3; }
+constexpr int makeSquare(int file, int rank) { return rank * BOARD_SIZE + file; }
+constexpr bool isValidSquare(int square) { return square >= 0 && square < NUM_SQUARES; }
+
+// Color and type helpers
+constexpr int colorIndex(PieceColor color) { return static_cast<int>(color); }
+constexpr int typeIndex(PieceType type) { return static_cast<int>(type); }
+constexpr PieceColor oppositeColor(PieceColor color) {
+    return color == PieceColor::WHITE ? PieceColor::BLACK : PieceColor::WHITE;
+}
+
+// Function to check if a coordinate is valid
+constexpr bool isValidCoordinate(int x, int y) {
+    return x >= 0 && x < BOARD_SIZE && y >= 0 && y < BOARD_SIZE;
+}
+
+// Step offsets of the non-sliding pieces
+constexpr int knightDx[8] = {-2, -2, -1, -1, 1, 1, 2, 2};
+constexpr int knightDy[8] = {-1, 1, -2, 2, -2, 2, -1, 1};
+constexpr int kingDx[8] = {-1, -1, -1, 0, 0, 1, 1, 1};
+constexpr int kingDy[8] = {-1, 0, 1, -1, 1, -1, 0, 1};
+constexpr int pawnDx[2] = {-1, 1};
+constexpr int pawnDy[2][2] = {{1, 1}, {-1, -1}};  // White pawns attack towards rank 8, black pawns towards rank 1
+
+// Ray directions of the sliding pieces
+// Directions 0-3 run towards higher squares, 4-7 towards lower squares, and dir + 4 is the opposite of dir
+enum RayDirection { NORTH, EAST, NORTH_EAST, NORTH_WEST, SOUTH, WEST, SOUTH_WEST, SOUTH_EAST };
+constexpr int rayDx[8] = {0, 1, 1, -1, 0, -1, -1, 1};
+constexpr int rayDy[8] = {1, 0, 1, 1, -1, 0, -1, -1};
+
+// Function to build the attack table of a piece that steps once by each of the given offsets
+constexpr array<Bitboard, NUM_SQUARES> makeStepAttacks(const int dx[], const int dy[], int count) {
+    array<Bitboard, NUM_SQUARES> table{};
+    for (int square = 0; square < NUM_SQUARES; square++) {
+        for (int i = 0; i < count; i++) {
+            int x = fileOf(square) + dx[i];
+            int y = rankOf(square) + dy[i];
+            if (isValidCoordinate(x, y)) {
+                table[square] |= squareBB(makeSquare(x, y));
+            }
+        }
+    }
+    return table;
+}
+
+// Function to build the ray table: every square from a square to the board edge in each direction
+constexpr array<array<Bitboard, NUM_SQUARES>, 8> makeRayAttacks() {
+    array<array<Bitboard, NUM_SQUARES>, 8> table{};
+    for (int dir = 0; dir < 8; dir++) {
+        for (int square = 0; square < NUM_SQUARES; square++) {
+            int x = fileOf(square) + rayDx[dir];
+            int y = rankOf(square) + rayDy[dir];
+            while (isValidCoordinate(x, y)) {
+                table[dir][square] |= squareBB(makeSquare(x, y));
+                x += rayDx[dir];
+                y += rayDy[dir];
+            }
+        }
+    }
+    return table;
+}
+
+// Attack tables for the non-sliding pieces and rays for the sliding pieces, all built by the compiler
+constexpr array<Bitboard, NUM_SQUARES> knightAttacks = makeStepAttacks(knightDx, knightDy, 8);
+constexpr array<Bitboard, NUM_SQUARES> kingAttacks = makeStepAttacks(kingDx, kingDy, 8);
+constexpr array<Bitboard, NUM_SQUARES> pawnAttacks[2] = {makeStepAttacks(pawnDx, pawnDy[0], 2),
+                                                         makeStepAttacks(pawnDx, pawnDy[1], 2)};
+constexpr array<array<Bitboard, NUM_SQUARES>, 8> rayAttacks = makeRayAttacks();
+
+// Function to build the between or line table from the rays: between holds the squares strictly between two
+// aligned squares, line the full board-edge-to-edge line through them; both are empty if the squares are not aligned
+constexpr array<array<Bitboard, NUM_SQUARES>, NUM_SQUARES> makeLineTable(bool between) {
+    array<array<Bitboard, NUM_SQUARES>, NUM_SQUARES> table{};
+    for (int s1 = 0; s1 < NUM_SQUARES; s1++) {
+        for (int dir = 0; dir < 8; dir++) {
+            Bitboard ray = rayAttacks[dir][s1];
+            Bitboard line = ray | rayAttacks[(dir + 4) % 8][s1] | squareBB(s1);
+            for (int s2 = 0; s2 < NUM_SQUARES; s2++) {
+                if (ray & squareBB(s2)) {
+                    table[s1][s2] = between ? ray & ~rayAttacks[dir][s2] & ~squareBB(s2) : line;
+                }
+            }
+        }
+    }
+    return table;
+}
+
+constexpr array<array<Bitboard, NUM_SQUARES>, NUM_SQUARES> betweenBB = makeLineTable(true);
+constexpr array<array<Bitboard, NUM_SQUARES>, NUM_SQUARES> lineBB = makeLineTable(false);
+
+// Magic bitboard entry for one square of a sliding piece
+struct Magic {
+    Bitboard mask;      // Squares whose occupancy can block the piece (board edges excluded)
+    Bitboard magic;     // Multiplier that hashes the masked occupancy into an index
+    Bitboard* attacks;  // This square's slice of the shared attack table
+    int shift;          // 64 minus the number of mask bits
+};
+
+// Magic attack tables for the sliding pieces, queens use the union of both
+Magic bishopMagics[NUM_SQUARES];
+Magic rookMagics[NUM_SQUARES];
+Bitboard bishopTable[5248];
+Bitboard rookTable[102400];
+
+// Zobrist keys, XORed together to hash a position
+Key pieceKeys[2][6][NUM_SQUARES];
+Key sideKey;                              // Black to move
+Key castlingKeys[16];                     // One per combination of castling rights
+Key enPassantKeys[BOARD_SIZE];            // One per en-passant file
+
+// Material plus piece-square value of each piece on each square, black's negated (filled by initializeEvaluation)
+int psqTableMg[2][6][NUM_SQUARES];
+int psqTableEg[2][6][NUM_SQUARES];
+
+// Game phase weight of each piece type: 24 with all minor and major pieces on the board
+const int phaseWeights[6] = {0, 4, 2, 1, 1, 0};
+const int MAX_PHASE = 24;
+
+// Quantized NNUE weights, loaded from a file by loadNetwork
+struct NnueWeights {
+    alignas(32) int16_t featureWeights[NNUE_INPUTS][NNUE_HIDDEN];
+    alignas(32) int16_t featureBias[NNUE_HIDDEN];
+    alignas(32) int16_t outputWeights[2][NNUE_HIDDEN]; // Side to move's half first, then the other side's
+    int16_t outputBias;
+};
+NnueWeights nnueWeights;
+bool useNnue = false;                     // Evaluate with the network instead of the hand-written terms
+
+// Instruction sets the NNUE kernels can use, the best one is picked when the network is loaded
+enum class SimdLevel { SCALAR, SSE41, AVX2 };
+SimdLevel simdLevel = SimdLevel::SCALAR;
+
+// Index the attack tables with PEXT instead of magic multiplication (--pext on, in BMI2 builds only).
+// Magics are the default: PEXT is no faster on most Intel CPUs and far slower on AMD Zen 1 and 2
+bool usePext = false;
+
+// Symbol of each piece type, indexed by typeIndex
+constexpr char pieceSymbols[] = "KQRBNP ";
+
+// Function to get the squares along a ray up to and including the first blocker
+Bitboard rayAttacksToBlocker(int dir, int square, Bitboard occupied) {
+    Bitboard attacks = rayAttacks[dir][square];
+    Bitboard blockers = attacks & occupied;
+    if (blockers) {
+        int blocker = (dir < SOUTH) ? lsb(blockers) : msb(blockers);
+        attacks ^= rayAttacks[dir][blocker];
+    }
+    return attacks;
+}
+
+// Function to get the squares a bishop attacks by walking its rays (used to build the magic tables)
+Bitboard bishopRayAttacks(int square, Bitboard occupied) {
+    return rayAttacksToBlocker(NORTH_EAST, square, occupied) | rayAttacksToBlocker(NORTH_WEST, square, occupied) |
+           rayAttacksToBlocker(SOUTH_WEST, square, occupied) | rayAttacksToBlocker(SOUTH_EAST, square, occupied);
+}
+
+// Function to get the squares a rook attacks by walking its rays (used to build the magic tables)
+Bitboard rookRayAttacks(int square, Bitboard occupied) {
+    return rayAttacksToBlocker(NORTH, square, occupied) | rayAttacksToBlocker(EAST, square, occupied) |
+           rayAttacksToBlocker(SOUTH, square, occupied) | rayAttacksToBlocker(WEST, square, occupied);
+}
+
+#ifdef HAS_PEXT_SUPPORT
+// Function to gather the masked occupancy bits into a dense index with the BMI2 PEXT instruction
+inline unsigned pextIndex(Bitboard occupied, Bitboard mask) {
+    return static_cast<unsigned>(_pext_u64(occupied, mask));
+}
+#endif
+
+// Function to get the attack table index of an occupancy for a magic entry
+inline unsigned magicIndex(const Magic& m, Bitboard occupied) {
+#ifdef HAS_PEXT_SUPPORT
+    if (usePext) {
+        return pextIndex(occupied, m.mask);
+    }
+#endif
+    return static_cast<unsigned>(((occupied & m.mask) * m.magic) >> m.shift);
+}
+
+// Function to generate the next pseudo-random number from a seed with the xorshift64* generator
+Bitboard nextRandom(Bitboard& seed) {
+    seed ^= seed >> 12;
+    seed ^= seed << 25;
+    seed ^= seed >> 27;
+    return seed * 2685821657736338717ULL;
+}
+
+// Function to generate a random number with few bits set, good candidates for magics
+Bitboard sparseRandom(Bitboard& seed) {
+    return nextRandom(seed) & nextRandom(seed) & nextRandom(seed);
+}
+
+// Function to find the magic numbers and fill the attack table for one sliding piece
+void initializeMagics(Magic magics[], Bitboard table[], Bitboard (*rayAttacksFn)(int, Bitboard)) {
+    // Fixed seeds per rank so the search is fast and the tables are identical on every run
+    const Bitboard seeds[BOARD_SIZE] = {728, 10316, 55013, 32803, 12281, 15100, 16645, 255};
+    Bitboard occupancy[4096];
+    Bitboard reference[4096];
+    int epoch[4096] = {};
+    int attempt = 0;
+    Bitboard* next = table;
+
+    for (int square = 0; square < NUM_SQUARES; square++) {
+        Magic& m = magics[square];
+
+        // Edges only block when they are the last square of a ray, so they are left out of the mask
+        Bitboard edges = ((RANK_1_BB | RANK_8_BB) & ~(RANK_1_BB << (8 * rankOf(square)))) |
+                         ((FILE_A_BB | FILE_H_BB) & ~(FILE_A_BB << fileOf(square)));
+        m.mask = rayAttacksFn(square, 0) & ~edges;
+        m.shift = 64 - popCount(m.mask);
+        m.attacks = next;
+
+        // Enumerate every subset of the mask with the carry-rippler trick
+        int size = 0;
+        Bitboard subset = 0;
+        do {
+            occupancy[size] = subset;
+            reference[size] = rayAttacksFn(square, subset);
+            size++;
+            subset = (subset - m.mask) & m.mask;
+        } while (subset);
+        next += size;
+
+#ifdef HAS_PEXT_SUPPORT
+        if (usePext) {
+            m.magic = 0;
+            for (int i = 0; i < size; i++) {
+                m.attacks[pextIndex(occupancy[i], m.mask)] = reference[i];
+            }
+            continue;
+        }
+#endif
+
+        // Try random magics until one maps every subset without a destructive collision
+        Bitboard seed = seeds[rankOf(square)];
+        bool found = false;
+        while (!found) {
+            do {
+                m.magic = sparseRandom(seed);
+            } while (popCount((m.magic * m.mask) >> 56) < 6);
+
+            attempt++;
+            found = true;
+            for (int i = 0; i < size; i++) {
+                unsigned index = magicIndex(m, occupancy[i]);
+                if (epoch[index] < attempt) {
+                    epoch[index] = attempt;
+                    m.attacks[index] = reference[i];
+                } else if (m.attacks[index] != reference[i]) {
+                    found = false;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+// Function to initialize the sliding piece attack tables, laid out for PEXT indexing when usePext is set
+void initializeSlidingAttacks() {
+    initializeMagics(bishopMagics, bishopTable, bishopRayAttacks);
+    initializeMagics(rookMagics, rookTable, rookRayAttacks);
+}
+
+// Function to get the squares a bishop attacks given the board occupancy
+inline Bitboard bishopAttacks(int square, Bitboard occupied) {
+    const Magic& m = bishopMagics[square];
+    return m.attacks[magicIndex(m, occupied)];
+}
+
+// Function to get the squares a rook attacks given the board occupancy
+inline Bitboard rookAttacks(int square, Bitboard occupied) {
+    const Magic& m = rookMagics[square];
+    return m.attacks[magicIndex(m, occupied)];
+}
+
+// Function to get the squares a queen attacks given the board occupancy
+inline Bitboard queenAttacks(int square, Bitboard occupied) {
+    return bishopAttacks(square, occupied) | rookAttacks(square, occupied);
+}
+
+// Function to initialize the Zobrist keys from a fixed seed so hashes are the same on every run
+void initializeZobrist() {
+    Bitboard seed = 1070372;
+    for (int color = 0; color < 2; color++) {
+        for (int type = 0; type < 6; type++) {
+            for (int square = 0; square < NUM_SQUARES; square++) {
+                pieceKeys[color][type][square] = nextRandom(seed);
+            }
+        }
+    }
+    sideKey = nextRandom(seed);
+    // Combined rights hash as the XOR of the single rights so that clearing one right is one XOR pair
+    Key singleRightKeys[4];
+    for (int i = 0; i < 4; i++) {
+        singleRightKeys[i] = nextRandom(seed);
+    }
+    for (int rights = 0; rights < 16; rights++) {
+        castlingKeys[rights] = 0;
+        for (int i = 0; i < 4; i++) {
+            if (rights & (1 << i)) {
+                castlingKeys[rights] ^= singleRightKeys[i];
+            }
+        }
+    }
+    for (int file = 0; file < BOARD_SIZE; file++) {
+        enPassantKeys[file] = nextRandom(seed);
+    }
+}
+
+// Function to get the NNUE input of a piece seen from one side: the side's own pieces come first, and
+// black sees the board flipped so that both sides see their pieces from their own first rank
+inline int featureIndex(PieceColor perspective, PieceColor color, PieceType type, int square) {
+    int relativeSquare = perspective == PieceColor::WHITE ? square : square ^ 56;
+    return (color == perspective ? 0 : 6 * 64) + typeIndex(type) * 64 + relativeSquare;
+}
+
+// Row of zeros, used as the added or removed row when an accumulator update only goes one way
+alignas(32) const int16_t zeroRow[NNUE_HIDDEN] = {};
+
+// Kernels to add one weight row to an accumulator and subtract another, in plain C++ and with SSE4.1 and AVX2
+void updateAccumulatorScalar(int16_t* acc, const int16_t* added, const int16_t* removed) {
+    for (int i = 0; i < NNUE_HIDDEN; i++) {
+        acc[i] = static_cast<int16_t>(acc[i] + added[i] - removed[i]);
+    }
+}
+
+#ifdef HAS_SIMD_SUPPORT
+__attribute__((target("sse4.1"))) void updateAccumulatorSse41(int16_t* acc, const int16_t* added, const int16_t* removed) {
+    for (int i = 0; i < NNUE_HIDDEN; i += 8) {
+        __m128i* a = reinterpret_cast<__m128i*>(acc + i);
+        __m128i sum = _mm_add_epi16(_mm_load_si128(a), _mm_load_si128(reinterpret_cast<const __m128i*>(added + i)));
+        _mm_store_si128(a, _mm_sub_epi16(sum, _mm_load_si128(reinterpret_cast<const __m128i*>(removed + i))));
+    }
+}
+
+__attribute__((target("avx2"))) void updateAccumulatorAvx2(int16_t* acc, const int16_t* added, const int16_t* removed) {
+    for (int i = 0; i < NNUE_HIDDEN; i += 16) {
+        __m256i* a = reinterpret_cast<__m256i*>(acc + i);
+        __m256i sum = _mm256_add_epi16(_mm256_load_si256(a), _mm256_load_si256(reinterpret_cast<const __m256i*>(added + i)));
+        _mm256_store_si256(a, _mm256_sub_epi16(sum, _mm256_load_si256(reinterpret_cast<const __m256i*>(removed + i))));
+    }
+}
+#endif
+
+// Function to add one weight row to an accumulator and subtract another with the best kernel available
+inline void updateAccumulator(int16_t* acc, const int16_t* added, const int16_t* removed) {
+#ifdef HAS_SIMD_SUPPORT
+    if (simdLevel == SimdLevel::AVX2) {
+        updateAccumulatorAvx2(acc, added, removed);
+        return;
+    }
+    if (simdLevel == SimdLevel::SSE41) {
+        updateAccumulatorSse41(acc, added, removed);
+        return;
+    }
+#endif
+    updateAccumulatorScalar(acc, added, removed);
+}
+
+// Function to get the weight row of a piece's NNUE input seen from one side
+inline const int16_t* featureRow(PieceColor perspective, PieceColor color, PieceType type, int square) {
+    return nnueWeights.featureWeights[featureIndex(perspective, color, type, square)];
+}
+
+// Function to rebuild both accumulators of a position from scratch
+void refreshAccumulators(const Position& pos, StateStack& states) {
+    memset(states.accumulator, 0, sizeof(states.accumulator));
+    for (int side = 0; side < 2; side++) {
+        for (int color = 0; color < 2; color++) {
+            for (int type = 0; type < 6; type++) {
+                Bitboard pieces = pos.pieces[color][type];
+                while (pieces) {
+                    updateAccumulator(states.accumulator[side], featureRow(static_cast<PieceColor>(side),
+                        static_cast<PieceColor>(color), static_cast<PieceType>(type), popLsb(pieces)), zeroRow);
+                }
+            }
+        }
+    }
+}
+
+// Function to empty a state stack for a newly set up position, refreshing its accumulators while NNUE is in use
+void resetStateStack(const Position& pos, StateStack& states) {
+    states.size = 0;
+    if (useNnue) {
+        refreshAccumulators(pos, states);
+    }
+}
+
+// Function to place a piece on a square
+void putPiece(Position& pos, int square, PieceType type, PieceColor color) {
+    Bitboard b = squareBB(square);
+    pos.squares[square] = packPiece(type, color);
+    pos.pieces[colorIndex(color)][typeIndex(type)] |= b;
+    pos.occupied[colorIndex(color)] |= b;
+    pos.allPieces |= b;
+    pos.key ^= pieceKeys[colorIndex(color)][typeIndex(type)][square];
+    if (type == PieceType::PAWN) {
+        pos.pawnKey ^= pieceKeys[colorIndex(color)][typeIndex(type)][square];
+    }
+    pos.mgScore += psqTableMg[colorIndex(color)][typeIndex(type)][square];
+    pos.egScore += psqTableEg[colorIndex(color)][typeIndex(type)][square];
+    pos.phase += phaseWeights[typeIndex(type)];
+}
+
+// Function to remove a piece from a square
+void removePiece(Position& pos, int square, PieceType type, PieceColor color) {
+    Bitboard b = squareBB(square);
+    pos.squares[square] = NO_PIECE;
+    pos.pieces[colorIndex(color)][typeIndex(type)] &= ~b;
+    pos.occupied[colorIndex(color)] &= ~b;
+    pos.allPieces &= ~b;
+    pos.key ^= pieceKeys[colorIndex(color)][typeIndex(type)][square];
+    if (type == PieceType::PAWN) {
+        pos.pawnKey ^= pieceKeys[colorIndex(color)][typeIndex(type)][square];
+    }
+    pos.mgScore -= psqTableMg[colorIndex(color)][typeIndex(type)][square];
+    pos.egScore -= psqTableEg[colorIndex(color)][typeIndex(type)][square];
+    pos.phase -= phaseWeights[typeIndex(type)];
+}
+
+// Function to compute a position's Zobrist key from scratch
+Key computeKey(const Position& pos) {
+    Key key = 0;
+    for (int color = 0; color < 2; color++) {
+        for (int type = 0; type < 6; type++) {
+            Bitboard pieces = pos.pieces[color][type];
+            while (pieces) {
+                key ^= pieceKeys[color][type][popLsb(pieces)];
+            }
         }
     }
+    if (pos.sideToMove == PieceColor::BLACK) {
+        key ^= sideKey;
+    }
+    key ^= castlingKeys[pos.castlingRights];
+    if (pos.enPassantSquare != NO_SQUARE) {
+        key ^= enPassantKeys[fileOf(pos.enPassantSquare)];
+    }
+    return key;
+}
+
+// Function to get the piece standing on a square
+inline Piece pieceAt(const Position& pos, int square) {
+    return {pos.squares[square]};
+}
+
+// Function to get the square of a color's king
+int kingSquare(const Position& pos, PieceColor color) {
+    Bitboard king = pos.pieces[colorIndex(color)][typeIndex(PieceType::KING)];
+    return king ? lsb(king) : NO_SQUARE;
+}
+
+// Function to set up a position with the pieces in their starting squares
+void initializeBoard(Position& board) {
+    // Clear the board
+    board = Position();
 
     // Initialize pawns
     for (int col = 0; col < BOARD_SIZE; col++) {
-        board[1][col] = {PieceType::PAWN, PieceColor::WHITE};
-        board[6][col] = {PieceType::PAWN, PieceColor::BLACK};
+        putPiece(board, makeSquare(col, 1), PieceType::PAWN, PieceColor::WHITE);
+        putPiece(board, makeSquare(col, 6), PieceType::PAWN, PieceColor::BLACK);
     }
 
     // Initialize major pieces
-    board[0][0] = {PieceType::ROOK, PieceColor::WHITE};
-    board[0][1] = {PieceType::KNIGHT, PieceColor::WHITE};
-    board[0][2] = {PieceType::BISHOP, PieceColor::WHITE};
-    board[0][3] = {PieceType::QUEEN, PieceColor::WHITE};
-    board[0][4] = {PieceType::KING, PieceColor::WHITE};
-    board[0][5] = {PieceType::BISHOP, PieceColor::WHITE};
-    board[0][6] = {PieceType::KNIGHT, PieceColor::WHITE};
-    board[0][7] = {PieceType::ROOK, PieceColor::WHITE};
-
-    board[7][0] = {PieceType::ROOK, PieceColor::BLACK};
-    board[7][1] = {PieceType::KNIGHT, PieceColor::BLACK};
-    board[7][2] = {PieceType::BISHOP, PieceColor::BLACK};
-    board[7][3] = {PieceType::QUEEN, PieceColor::BLACK};
-    board[7][4] = {PieceType::KING, PieceColor::BLACK};
-    board[7][5] = {PieceType::BISHOP, PieceColor::BLACK};
-    board[7][6] = {PieceType::KNIGHT, PieceColor::BLACK};
-    board[7][7] = {PieceType::ROOK, PieceColor::BLACK};
+    const PieceType backRank[BOARD_SIZE] = {
+        PieceType::ROOK, PieceType::KNIGHT, PieceType::BISHOP, PieceType::QUEEN,
+        PieceType::KING, PieceType::BISHOP, PieceType::KNIGHT, PieceType::ROOK
+    };
+    for (int col = 0; col < BOARD_SIZE; col++) {
+        putPiece(board, makeSquare(col, 0), backRank[col], PieceColor::WHITE);
+        putPiece(board, makeSquare(col, 7), backRank[col], PieceColor::BLACK);
+    }
+
+    board.sideToMove = PieceColor::WHITE;
+    board.castlingRights = ALL_CASTLING;
+    board.key = computeKey(board);
+}
+
+// Function to display the chessboard
+void displayBoard(const Position& board) {
+    cout << "  a b c d e f g h" << endl;
+    for (int row = BOARD_SIZE - 1; row >= 0; row--) {
+        cout << row + 1 << " ";
+        for (int col = 0; col < BOARD_SIZE; col++) {
+            Piece piece = pieceAt(board, makeSquare(col, row));
+            char symbol = pieceSymbols[typeIndex(piece.type())];
+            if (piece.color() == PieceColor::BLACK) {
+                symbol = tolower(symbol); // Black pieces are shown in lowercase
+            }
+            cout << symbol << " ";
+        }
+        cout << row + 1 << endl;
+    }
+    cout << "  a b c d e f g h" << endl;
+}
+
+// Function to convert algebraic notation to a board square
+int convertAlgebraicToSquare(const string& position) {
+    if (position.size() != 2) return NO_SQUARE;
+    int col = position[0] - 'a';
+    int row = position[1] - '1';
+    if (!isValidCoordinate(col, row)) return NO_SQUARE;
+    return makeSquare(col, row);
+}
+
+// Function to convert a board square to algebraic notation
+string convertSquareToAlgebraic(int square) {
+    string result;
+    result += ('a' + fileOf(square));
+    result += ('1' + rankOf(square));
+    return result;
+}
+
+// Function to set up a position from a FEN string, returns false if the FEN is malformed
+bool setFromFEN(Position& pos, const string& fen) {
+    istringstream fields(fen);
+    string placement, side, castling, enPassant;
+    if (!(fields >> placement >> side >> castling >> enPassant)) {
+        return false;
+    }
+
+    pos = Position();
+    int row = BOARD_SIZE - 1;
+    int col = 0;
+    for (char c : placement) {
+        if (c == '/') {
+            row--;
+            col = 0;
+        } else if (c >= '1' && c <= '8') {
+            col += c - '0';
+        } else {
+            const string symbols = "KQRBNP";
+            size_t type = symbols.find(toupper(c));
+            if (type == string::npos || !isValidCoordinate(col, row)) {
+                return false;
+            }
+            putPiece(pos, makeSquare(col, row), static_cast<PieceType>(type),
+                     isupper(c) ? PieceColor::WHITE : PieceColor::BLACK);
+            col++;
+        }
+    }
+    if (popCount(pos.pieces[colorIndex(PieceColor::WHITE)][typeIndex(PieceType::KING)]) != 1 ||
+        popCount(pos.pieces[colorIndex(PieceColor::BLACK)][typeIndex(PieceType::KING)]) != 1) {
+        return false;
+    }
+
+    if (side != "w" && side != "b") {
+        return false;
+    }
+    pos.sideToMove = (side == "w") ? PieceColor::WHITE : PieceColor::BLACK;
+
+    for (char c : castling) {
+        switch (c) {
+            case 'K': pos.castlingRights |= WHITE_KINGSIDE; break;
+            case 'Q': pos.castlingRights |= WHITE_QUEENSIDE; break;
+            case 'k': pos.castlingRights |= BLACK_KINGSIDE; break;
+            case 'q': pos.castlingRights |= BLACK_QUEENSIDE; break;
+            case '-': break;
+            default: return false;
+        }
+    }
+    // Like the en-passant square, only keep a right when its king and rook are still on their home squares
+    const int rookCorners[4] = {7, 0, 63, 56};  // Rook of WHITE_KINGSIDE, WHITE_QUEENSIDE, BLACK_KINGSIDE, BLACK_QUEENSIDE
+    for (int i = 0; i < 4; i++) {
+        PieceColor color = (i < 2) ? PieceColor::WHITE : PieceColor::BLACK;
+        int kingHome = makeSquare(4, (i < 2) ? 0 : 7);
+        if (pos.squares[kingHome] != packPiece(PieceType::KING, color) ||
+            pos.squares[rookCorners[i]] != packPiece(PieceType::ROOK, color)) {
+            pos.castlingRights &= ~(1 << i);
+        }
+    }
+
+    if (enPassant != "-") {
+        pos.enPassantSquare = convertAlgebraicToSquare(enPassant);
+        if (pos.enPassantSquare == NO_SQUARE) {
+            return false;
+        }
+        // Like doMove, only keep the square when a pawn can actually capture onto it
+        if (!(pawnAttacks[colorIndex(oppositeColor(pos.sideToMove))][pos.enPassantSquare] &
+              pos.pieces[colorIndex(pos.sideToMove)][typeIndex(PieceType::PAWN)])) {
+            pos.enPassantSquare = NO_SQUARE;
+        }
+    }
+
+    // The move clocks are optional
+    fields >> pos.halfmoveClock >> pos.fullmoveNumber;
+    pos.key = computeKey(pos);
+    return true;
+}
+
+// Function to convert a move to coordinate notation (e.g., e2e4, e7e8q)
+string convertMoveToString(const Move& move) {
+    string result = convertSquareToAlgebraic(move.from()) + convertSquareToAlgebraic(move.to());
+    if (move.flag() == MoveFlag::PROMOTION) {
+        result += static_cast<char>(tolower(pieceSymbols[typeIndex(move.promotion())]));
+    }
+    return result;
+}
+
+// Function to find every piece of a color that attacks a square, with the attacking color known at compile time
+template <PieceColor Them>
+Bitboard attackersTo(const Position& pos, int square, Bitboard occupied) {
+    const Bitboard* p = pos.pieces[colorIndex(Them)];
+    Bitboard queens = p[typeIndex(PieceType::QUEEN)];
+    return (pawnAttacks[colorIndex(oppositeColor(Them))][square] & p[typeIndex(PieceType::PAWN)]) |
+           (knightAttacks[square] & p[typeIndex(PieceType::KNIGHT)]) |
+           (kingAttacks[square] & p[typeIndex(PieceType::KING)]) |
+           (bishopAttacks(square, occupied) & (p[typeIndex(PieceType::BISHOP)] | queens)) |
+           (rookAttacks(square, occupied) & (p[typeIndex(PieceType::ROOK)] | queens));
+}
+
+// Function to find every piece of a color that attacks a square
+Bitboard attackersTo(const Position& pos, int square, PieceColor attackingColor, Bitboard occupied) {
+    return attackingColor == PieceColor::WHITE ? attackersTo<PieceColor::WHITE>(pos, square, occupied)
+                                               : attackersTo<PieceColor::BLACK>(pos, square, occupied);
+}
+
+// Function to check if a square is under attack by an opponent's piece
+bool isUnderAttack(const Position& pos, int square, PieceColor attackingColor) {
+    return attackersTo(pos, square, attackingColor, pos.allPieces) != 0;
+}
+
+// Function to check if a color's king is in check
+bool isInCheck(const Position& pos, PieceColor color) {
+    int king = kingSquare(pos, color);
+    return king != NO_SQUARE && isUnderAttack(pos, king, oppositeColor(color));
+}
+
+// Function to check if a move is valid for the king of the side Us
+template <PieceColor Us>
+bool isValidKingMove(const Position& pos, int start, int end) {
+    // Regular one-square king move
+    if (kingAttacks[start] & squareBB(end)) {
+        return true;
+    }
+
+    // Castling: the king moves two squares towards a rook that has not moved
+    constexpr int homeRank = (Us == PieceColor::WHITE) ? 0 : 7;
+    if (start != makeSquare(4, homeRank) || rankOf(end) != homeRank) {
+        return false;
+    }
+    constexpr PieceColor enemy = oppositeColor(Us);
+    if (fileOf(end) == 6) {
+        constexpr int right = (Us == PieceColor::WHITE) ? WHITE_KINGSIDE : BLACK_KINGSIDE;
+        Bitboard between = squareBB(makeSquare(5, homeRank)) | squareBB(makeSquare(6, homeRank));
+        return (pos.castlingRights & right) && pos.squares[makeSquare(7, homeRank)] == packPiece(PieceType::ROOK, Us) &&
+               !(pos.allPieces & between) &&
+               !attackersTo<enemy>(pos, start, pos.allPieces) &&
+               !attackersTo<enemy>(pos, makeSquare(5, homeRank), pos.allPieces);
+    }
+    if (fileOf(end) == 2) {
+        constexpr int right = (Us == PieceColor::WHITE) ? WHITE_QUEENSIDE : BLACK_QUEENSIDE;
+        Bitboard between = squareBB(makeSquare(1, homeRank)) | squareBB(makeSquare(2, homeRank)) |
+                           squareBB(makeSquare(3, homeRank));
+        return (pos.castlingRights & right) && pos.squares[makeSquare(0, homeRank)] == packPiece(PieceType::ROOK, Us) &&
+               !(pos.allPieces & between) &&
+               !attackersTo<enemy>(pos, start, pos.allPieces) &&
+               !attackersTo<enemy>(pos, makeSquare(3, homeRank), pos.allPieces);
+    }
+    return false;
+}
+
+// Function to check if a move is valid for the queen
+bool isValidQueenMove(const Position& pos, int start, int end) {
+    return (queenAttacks(start, pos.allPieces) & squareBB(end)) != 0;
+}
+
+// Function to check if a move is valid for the rook
+bool isValidRookMove(const Position& pos, int start, int end) {
+    return (rookAttacks(start, pos.allPieces) & squareBB(end)) != 0;
+}
+
+// Function to check if a move is valid for the bishop
+bool isValidBishopMove(const Position& pos, int start, int end) {
+    return (bishopAttacks(start, pos.allPieces) & squareBB(end)) != 0;
+}
+
+// Function to check if a move is valid for the knight
+bool isValidKnightMove(int start, int end) {
+    return (knightAttacks[start] & squareBB(end)) != 0;
+}
+
+// Function to check if a move is valid for a pawn of the side Us
+template <PieceColor Us>
+bool isValidPawnMove(const Position& pos, int start, int end) {
+    // Check direction based on piece color
+    constexpr int forwardDir = (Us == PieceColor::WHITE) ? BOARD_SIZE : -BOARD_SIZE;
+    constexpr int startRank = (Us == PieceColor::WHITE) ? 1 : 6;
+    Bitboard target = squareBB(end);
+
+    // Pawn moves forward by 1 square
+    if (end == start + forwardDir && !(pos.allPieces & target)) {
+        return true;
+    }
+
+    // Pawn moves forward by 2 squares from starting position
+    if (end == start + 2 * forwardDir && rankOf(start) == startRank &&
+        !(pos.allPieces & (squareBB(start + forwardDir) | target))) {
+        return true;
+    }
+
+    // Pawn captures diagonally
+    if (pawnAttacks[colorIndex(Us)][start] & target) {
+        if (pos.occupied[colorIndex(oppositeColor(Us))] & target) {
+            return true;
+        }
+
+        // En passant capture, only possible right after the enemy pawn's double step
+        if (end == pos.enPassantSquare) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Function to move a piece between two squares
+void movePiece(Position& pos, int from, int to, PieceType type, PieceColor color) {
+    Bitboard fromTo = squareBB(from) | squareBB(to);
+    pos.squares[to] = pos.squares[from];
+    pos.squares[from] = NO_PIECE;
+    pos.pieces[colorIndex(color)][typeIndex(type)] ^= fromTo;
+    pos.occupied[colorIndex(color)] ^= fromTo;
+    pos.allPieces ^= fromTo;
+    pos.key ^= pieceKeys[colorIndex(color)][typeIndex(type)][from] ^ pieceKeys[colorIndex(color)][typeIndex(type)][to];
+    if (type == PieceType::PAWN) {
+        pos.pawnKey ^= pieceKeys[colorIndex(color)][typeIndex(type)][from] ^ pieceKeys[colorIndex(color)][typeIndex(type)][to];
+    }
+    pos.mgScore += psqTableMg[colorIndex(color)][typeIndex(type)][to] - psqTableMg[colorIndex(color)][typeIndex(type)][from];
+    pos.egScore += psqTableEg[colorIndex(color)][typeIndex(type)][to] - psqTableEg[colorIndex(color)][typeIndex(type)][from];
+}
+
+// Function to handle castling: move the rook next to the king, or back to its corner when undoing
+void handleCastling(Position& pos, int kingFrom, int kingTo, PieceColor color, bool undo) {
+    int rank = rankOf(kingFrom);
+    bool kingside = kingTo > kingFrom;
+    int rookCorner = makeSquare(kingside ? BOARD_SIZE - 1 : 0, rank);
+    int rookTarget = kingside ? kingTo - 1 : kingTo + 1;
+    if (undo) {
+        movePiece(pos, rookTarget, rookCorner, PieceType::ROOK, color);
+    } else {
+        movePiece(pos, rookCorner, rookTarget, PieceType::ROOK, color);
+    }
 }
 
-// Function to display the chessboard
-void displayBoard() {
-    cout << "  a b c d e f g h" << endl;
-    for (int row = 0; row < BOARD_SIZE; row++) {
-        cout << 8 - row << " ";
-        for (int col = 0; col < BOARD_SIZE; col++) {
-            cout << pieceSymbols[board[row][col].type] << " ";
+// Function to apply the NNUE input changes of a move by the given color to both accumulators, or to take
+// them back when undoing. Each piece that moves has its old and new rows applied in one pass
+void updateMoveFeatures(StateStack& states, const Move& move, PieceType moving, PieceType captured,
+                        PieceColor color, bool undo) {
+    PieceType placed = move.flag() == MoveFlag::PROMOTION ? move.promotion() : moving;
+    for (int side = 0; side < 2; side++) {
+        PieceColor perspective = static_cast<PieceColor>(side);
+        int16_t* acc = states.accumulator[side];
+        const int16_t* fromRow = featureRow(perspective, color, moving, move.from());
+        const int16_t* toRow = featureRow(perspective, color, placed, move.to());
+        updateAccumulator(acc, undo ? fromRow : toRow, undo ? toRow : fromRow);
+        if (move.flag() == MoveFlag::CASTLING) {
+            bool kingside = move.to() > move.from();
+            const int16_t* cornerRow = featureRow(perspective, color, PieceType::ROOK,
+                                                  makeSquare(kingside ? BOARD_SIZE - 1 : 0, rankOf(move.from())));
+            const int16_t* targetRow = featureRow(perspective, color, PieceType::ROOK,
+                                                  kingside ? move.to() - 1 : move.to() + 1);
+            updateAccumulator(acc, undo ? cornerRow : targetRow, undo ? targetRow : cornerRow);
+        } else if (captured != PieceType::NONE) {
+            int square = move.flag() == MoveFlag::EN_PASSANT ? makeSquare(fileOf(move.to()), rankOf(move.from())) : move.to();
+            const int16_t* row = featureRow(perspective, oppositeColor(color), captured, square);
+            updateAccumulator(acc, undo ? row : zeroRow, undo ? zeroRow : row);
+        }
+    }
+}
+
+// Function to handle pawn promotion
+void promotePawn(Position& pos, int square, PieceColor color, PieceType promotedType) {
+    removePiece(pos, square, PieceType::PAWN, color);
+    putPiece(pos, square, promotedType, color);
+}
+
+// Function to get the castling rights lost when a piece leaves or lands on a square
+int castlingRightsLost(int square) {
+    switch (square) {
+        case 0:  return WHITE_QUEENSIDE;
+        case 4:  return WHITE_KINGSIDE | WHITE_QUEENSIDE;
+        case 7:  return WHITE_KINGSIDE;
+        case 56: return BLACK_QUEENSIDE;
+        case 60: return BLACK_KINGSIDE | BLACK_QUEENSIDE;
+        case 63: return BLACK_KINGSIDE;
+        default: return 0;
+    }
+}
+
+// Function to make a move for the side to move Us, saving what undoMove needs on the state stack
+template <PieceColor Us>
+void doMove(Position& pos, StateStack& states, const Move& move) {
+    constexpr PieceColor color = Us;
+    constexpr PieceColor enemy = oppositeColor(Us);
+    PieceType moving = pieceAt(pos, move.from()).type();
+
+    StateInfo& st = states.entries[states.size++];
+    st.move = move;
+    st.captured = PieceType::NONE;
+    st.castlingRights = pos.castlingRights;
+    st.enPassantSquare = pos.enPassantSquare;
+    st.halfmoveClock = pos.halfmoveClock;
+    st.key = pos.key;
+
+    if (move.flag() == MoveFlag::CASTLING) {
+        handleCastling(pos, move.from(), move.to(), color, false);
+    } else if (move.flag() == MoveFlag::EN_PASSANT) {
+        // The captured pawn sits beside the moving pawn, on the destination file
+        st.captured = PieceType::PAWN;
+        removePiece(pos, makeSquare(fileOf(move.to()), rankOf(move.from())), PieceType::PAWN, enemy);
+    } else if (pos.occupied[colorIndex(enemy)] & squareBB(move.to())) {
+        st.captured = pieceAt(pos, move.to()).type();
+        removePiece(pos, move.to(), st.captured, enemy);
+    }
+
+    movePiece(pos, move.from(), move.to(), moving, color);
+    if (move.flag() == MoveFlag::PROMOTION) {
+        promotePawn(pos, move.to(), color, move.promotion());
+    }
+    if (useNnue) {
+        updateMoveFeatures(states, move, moving, st.captured, color, false);
+    }
+
+    // Update the game state, hashing out the old rights and en-passant file and hashing in the new ones
+    pos.key ^= castlingKeys[pos.castlingRights];
+    pos.castlingRights &= ~(castlingRightsLost(move.from()) | castlingRightsLost(move.to()));
+    pos.key ^= castlingKeys[pos.castlingRights];
+    if (pos.enPassantSquare != NO_SQUARE) {
+        pos.key ^= enPassantKeys[fileOf(pos.enPassantSquare)];
+        pos.enPassantSquare = NO_SQUARE;
+    }
+    // The en-passant square is only recorded when an enemy pawn can capture onto it,
+    // so that otherwise identical positions hash the same
+    if (moving == PieceType::PAWN && abs(move.to() - move.from()) == 2 * BOARD_SIZE &&
+        (pawnAttacks[colorIndex(color)][(move.from() + move.to()) / 2] & pos.pieces[colorIndex(enemy)][typeIndex(PieceType::PAWN)])) {
+        pos.enPassantSquare = (move.from() + move.to()) / 2;
+        pos.key ^= enPassantKeys[fileOf(pos.enPassantSquare)];
+    }
+    pos.halfmoveClock = (moving == PieceType::PAWN || st.captured != PieceType::NONE) ? 0 : pos.halfmoveClock + 1;
+    if (color == PieceColor::BLACK) {
+        pos.fullmoveNumber++;
+    }
+    pos.sideToMove = enemy;
+    pos.key ^= sideKey;
+}
+
+// Function to make a move on a position, saving what undoMove needs on the state stack
+void doMove(Position& pos, StateStack& states, const Move& move) {
+    if (pos.sideToMove == PieceColor::WHITE) {
+        doMove<PieceColor::WHITE>(pos, states, move);
+    } else {
+        doMove<PieceColor::BLACK>(pos, states, move);
+    }
+}
+
+// Function to take back the last move made with doMove by the side Us
+template <PieceColor Us>
+void undoMove(Position& pos, StateStack& states) {
+    const StateInfo& st = states.entries[--states.size];
+    const Move& move = st.move;
+    constexpr PieceColor color = Us;
+    constexpr PieceColor enemy = oppositeColor(Us);
+    if (useNnue) {
+        PieceType moving = move.flag() == MoveFlag::PROMOTION ? PieceType::PAWN : pieceAt(pos, move.to()).type();
+        updateMoveFeatures(states, move, moving, st.captured, color, true);
+    }
+
+    pos.sideToMove = color;
+    if (color == PieceColor::BLACK) {
+        pos.fullmoveNumber--;
+    }
+    pos.castlingRights = st.castlingRights;
+    pos.enPassantSquare = st.enPassantSquare;
+    pos.halfmoveClock = st.halfmoveClock;
+
+    if (move.flag() == MoveFlag::PROMOTION) {
+        removePiece(pos, move.to(), move.promotion(), color);
+        putPiece(pos, move.to(), PieceType::PAWN, color);
+    }
+    movePiece(pos, move.to(), move.from(), pieceAt(pos, move.to()).type(), color);
+
+    if (move.flag() == MoveFlag::CASTLING) {
+        handleCastling(pos, move.from(), move.to(), color, true);
+    } else if (move.flag() == MoveFlag::EN_PASSANT) {
+        putPiece(pos, makeSquare(fileOf(move.to()), rankOf(move.from())), PieceType::PAWN, enemy);
+    } else if (st.captured != PieceType::NONE) {
+        putPiece(pos, move.to(), st.captured, enemy);
+    }
+    pos.key = st.key;
+}
+
+// Function to take back the last move made with doMove
+void undoMove(Position& pos, StateStack& states) {
+    // The side that made the move is the one not on move now
+    if (pos.sideToMove == PieceColor::BLACK) {
+        undoMove<PieceColor::WHITE>(pos, states);
+    } else {
+        undoMove<PieceColor::BLACK>(pos, states);
+    }
+}
+
+// Function to pass the turn without moving, for null-move pruning in the search
+void doNullMove(Position& pos, StateStack& states) {
+    StateInfo& st = states.entries[states.size++];
+    st.move = Move();
+    st.captured = PieceType::NONE;
+    st.castlingRights = pos.castlingRights;
+    st.enPassantSquare = pos.enPassantSquare;
+    st.halfmoveClock = pos.halfmoveClock;
+    st.key = pos.key;
+
+    if (pos.enPassantSquare != NO_SQUARE) {
+        pos.key ^= enPassantKeys[fileOf(pos.enPassantSquare)];
+        pos.enPassantSquare = NO_SQUARE;
+    }
+    // Positions from before the null move are not real repetitions of positions after it
+    pos.halfmoveClock = 0;
+    pos.sideToMove = oppositeColor(pos.sideToMove);
+    pos.key ^= sideKey;
+}
+
+// Function to take back a null move made with doNullMove
+void undoNullMove(Position& pos, StateStack& states) {
+    const StateInfo& st = states.entries[--states.size];
+    pos.sideToMove = oppositeColor(pos.sideToMove);
+    pos.enPassantSquare = st.enPassantSquare;
+    pos.halfmoveClock = st.halfmoveClock;
+    pos.key = st.key;
+}
+
+// Function to check if a move by the side Us puts its king in check, without making the move
+template <PieceColor Us>
+bool isMoveLeavesKingInCheck(const Position& pos, int start, int end) {
+    const Bitboard* own = pos.pieces[colorIndex(Us)];
+    Bitboard captured = squareBB(end);
+    if (end == pos.enPassantSquare && (own[typeIndex(PieceType::PAWN)] & squareBB(start))) {
+        captured |= squareBB(makeSquare(fileOf(end), rankOf(start)));
+    }
+
+    // Occupancy after the move; captured pieces no longer attack anything
+    Bitboard occupied = (pos.allPieces & ~squareBB(start) & ~captured) | squareBB(end);
+    int king = (own[typeIndex(PieceType::KING)] & squareBB(start)) ? end : kingSquare(pos, Us);
+    return (attackersTo<oppositeColor(Us)>(pos, king, occupied) & ~captured) != 0;
+}
+
+// Function to check if a move is valid for the side Us (including special moves)
+template <PieceColor Us>
+bool isValidMove(const Position& pos, int start, int end) {
+    // Validate squares
+    if (!isValidSquare(start) || !isValidSquare(end)) {
+        return false;
+    }
+
+    // Check if moving to the same position
+    if (start == end) {
+        return false;
+    }
+
+    // Check if the piece is of the correct color
+    Piece piece = pieceAt(pos, start);
+    if (piece.color() != Us) {
+        return false;
+    }
+
+    // Check if the destination square has the same color piece
+    if (pos.occupied[colorIndex(Us)] & squareBB(end)) {
+        return false;
+    }
+
+    switch (piece.type()) {
+        case PieceType::KING:
+            return isValidKingMove<Us>(pos, start, end) &&
+                   !isMoveLeavesKingInCheck<Us>(pos, start, end);
+        case PieceType::QUEEN:
+            return isValidQueenMove(pos, start, end) &&
+                   !isMoveLeavesKingInCheck<Us>(pos, start, end);
+        case PieceType::ROOK:
+            return isValidRookMove(pos, start, end) &&
+                   !isMoveLeavesKingInCheck<Us>(pos, start, end);
+        case PieceType::BISHOP:
+            return isValidBishopMove(pos, start, end) &&
+                   !isMoveLeavesKingInCheck<Us>(pos, start, end);
+        case PieceType::KNIGHT:
+            return isValidKnightMove(start, end) &&
+                   !isMoveLeavesKingInCheck<Us>(pos, start, end);
+        case PieceType::PAWN:
+            return isValidPawnMove<Us>(pos, start, end) &&
+                   !isMoveLeavesKingInCheck<Us>(pos, start, end);
+        default:
+            return false; // Invalid type
+    }
+}
+
+// Function to check if a move is valid (including special moves)
+bool isValidMove(const Position& pos, int start, int end, PieceColor color) {
+    return color == PieceColor::WHITE ? isValidMove<PieceColor::WHITE>(pos, start, end)
+                                      : isValidMove<PieceColor::BLACK>(pos, start, end);
+}
+
+// Function to compare two moves, including their flag: a rook move e1g1 is not the castling move e1g1
+inline bool sameMove(const Move& a, const Move& b) {
+    return a.packed == b.packed;
+}
+
+// Function to build a move from its squares, working out which special move it is
+Move createMove(const Position& pos, int start, int end, PieceType promotion) {
+    PieceType moving = pieceAt(pos, start).type();
+    if (moving == PieceType::KING && abs(fileOf(start) - fileOf(end)) == 2) {
+        return {start, end, PieceType::NONE, MoveFlag::CASTLING};
+    }
+    if (moving == PieceType::PAWN && end == pos.enPassantSquare) {
+        return {start, end, PieceType::NONE, MoveFlag::EN_PASSANT};
+    }
+    if (moving == PieceType::PAWN && (rankOf(end) == 0 || rankOf(end) == BOARD_SIZE - 1)) {
+        return {start, end, promotion == PieceType::NONE ? PieceType::QUEEN : promotion, MoveFlag::PROMOTION};
+    }
+    return {start, end, PieceType::NONE, MoveFlag::NORMAL};
+}
+
+// Function to check if a move remembered from another position, such as a hash move or killer, is legal here
+bool isLegalMove(const Position& pos, const Move& move) {
+    if (move.isNone() || !isValidMove(pos, move.from(), move.to(), pos.sideToMove)) {
+        return false;
+    }
+    // The stored flag and promotion piece must also match what the move means in this position
+    return sameMove(createMove(pos, move.from(), move.to(), move.promotion()), move);
+}
+
+// Function to add a pawn move for every target square, expanding promotions into all four pieces
+void addPawnMoves(Bitboard targets, int delta, MoveList& moves) {
+    while (targets) {
+        int to = popLsb(targets);
+        int from = to - delta;
+        if (rankOf(to) == 0 || rankOf(to) == BOARD_SIZE - 1) {
+            moves.push_back({from, to, PieceType::QUEEN, MoveFlag::PROMOTION});
+            moves.push_back({from, to, PieceType::ROOK, MoveFlag::PROMOTION});
+            moves.push_back({from, to, PieceType::BISHOP, MoveFlag::PROMOTION});
+            moves.push_back({from, to, PieceType::KNIGHT, MoveFlag::PROMOTION});
+        } else {
+            moves.push_back({from, to, PieceType::NONE, MoveFlag::NORMAL});
+        }
+    }
+}
+
+// Kinds of moves the generator can produce: captures include every promotion, quiet moves include castling
+enum class GenType { ALL, CAPTURES, QUIETS };
+
+// Function to generate the moves of a set of pawns of the side Us that land inside the target mask
+template <PieceColor Us>
+void generatePawnMoves(const Position& pos, Bitboard pawns, Bitboard targetMask, GenType type, MoveList& moves) {
+    constexpr bool white = Us == PieceColor::WHITE;
+    Bitboard enemies = pos.occupied[colorIndex(oppositeColor(Us))];
+    Bitboard empty = ~pos.allPieces;
+
+    // Shift directions based on piece color
+    constexpr int forward = white ? BOARD_SIZE : -BOARD_SIZE;
+    constexpr int captureWest = forward - 1;
+    constexpr int captureEast = forward + 1;
+
+    // Pushes by one square, then by two squares from the starting rank; pushes to the last rank count as captures
+    constexpr Bitboard promotionRank = white ? RANK_8_BB : RANK_1_BB;
+    Bitboard pushMask = type == GenType::CAPTURES ? promotionRank : type == GenType::QUIETS ? ~promotionRank : ~0ULL;
+    Bitboard single = shiftBB(pawns, forward) & empty;
+    addPawnMoves(single & targetMask & pushMask, forward, moves);
+    if (type != GenType::CAPTURES) {
+        Bitboard twice = shiftBB(single & (white ? RANK_3_BB : RANK_6_BB), forward) & empty;
+        addPawnMoves(twice & targetMask, 2 * forward, moves);
+    }
+    if (type == GenType::QUIETS) {
+        return;
+    }
+
+    // Diagonal captures, masking the edge files so shifts do not wrap around
+    addPawnMoves(shiftBB(pawns & ~FILE_A_BB, captureWest) & enemies & targetMask, captureWest, moves);
+    addPawnMoves(shiftBB(pawns & ~FILE_H_BB, captureEast) & enemies & targetMask, captureEast, moves);
+
+    // En passant removes two pieces from one rank, so it gets the full occupancy test instead of the masks
+    if (pos.enPassantSquare != NO_SQUARE) {
+        Bitboard capturers = pawnAttacks[colorIndex(oppositeColor(Us))][pos.enPassantSquare] & pawns;
+        while (capturers) {
+            int from = popLsb(capturers);
+            if (!isMoveLeavesKingInCheck<Us>(pos, from, pos.enPassantSquare)) {
+                moves.push_back({from, pos.enPassantSquare, PieceType::NONE, MoveFlag::EN_PASSANT});
+            }
+        }
+    }
+}
+
+// Function to generate the castling moves of the side Us
+template <PieceColor Us>
+void generateCastlingMoves(const Position& pos, int king, MoveList& moves) {
+    constexpr int rights = (Us == PieceColor::WHITE) ? (WHITE_KINGSIDE | WHITE_QUEENSIDE) : (BLACK_KINGSIDE | BLACK_QUEENSIDE);
+    if (!(pos.castlingRights & rights)) {
+        return;
+    }
+    for (int end = king - 2; end <= king + 2; end += 4) {
+        if (isValidSquare(end) && isValidKingMove<Us>(pos, king, end) &&
+            !isMoveLeavesKingInCheck<Us>(pos, king, end)) {
+            moves.push_back({king, end, PieceType::NONE, MoveFlag::CASTLING});
+        }
+    }
+}
+
+// Function to find the pieces of the side Us that are pinned to its own king
+template <PieceColor Us>
+Bitboard pinnedPieces(const Position& pos, int king) {
+    const Bitboard* enemy = pos.pieces[colorIndex(oppositeColor(Us))];
+    Bitboard queens = enemy[typeIndex(PieceType::QUEEN)];
+    Bitboard snipers = (rookAttacks(king, 0) & (enemy[typeIndex(PieceType::ROOK)] | queens)) |
+                       (bishopAttacks(king, 0) & (enemy[typeIndex(PieceType::BISHOP)] | queens));
+    Bitboard pinned = 0;
+    while (snipers) {
+        Bitboard blockers = betweenBB[king][popLsb(snipers)] & pos.allPieces;
+        // A lone blocker of our own color is pinned
+        if (blockers && !(blockers & (blockers - 1))) {
+            pinned |= blockers & pos.occupied[colorIndex(Us)];
+        }
+    }
+    return pinned;
+}
+
+// Function to generate the legal moves of the side Us, all of them or only the captures or quiet moves
+template <PieceColor Us>
+void generateLegalMoves(const Position& pos, MoveList& moves, GenType type) {
+    constexpr PieceColor color = Us;
+    constexpr PieceColor enemy = oppositeColor(Us);
+    const Bitboard* own = pos.pieces[colorIndex(color)];
+    // Squares the pieces other than pawns may land on for this kind of move
+    Bitboard targetSquares = type == GenType::CAPTURES ? pos.occupied[colorIndex(enemy)]
+                           : type == GenType::QUIETS ? ~pos.allPieces : ~pos.occupied[colorIndex(color)];
+    int king = kingSquare(pos, color);
+    if (king == NO_SQUARE) {
+        return;
+    }
+
+    // Checkers and pins are computed once for the whole position
+    Bitboard checkers = attackersTo<enemy>(pos, king, pos.allPieces);
+    Bitboard pinned = pinnedPieces<Us>(pos, king);
+
+    // King moves: the king itself is lifted off the board so it cannot hide behind its own square
+    Bitboard withoutKing = pos.allPieces ^ squareBB(king);
+    Bitboard kingTargets = kingAttacks[king] & targetSquares;
+    while (kingTargets) {
+        int to = popLsb(kingTargets);
+        if (!attackersTo<enemy>(pos, to, withoutKing)) {
+            moves.push_back({king, to, PieceType::NONE, MoveFlag::NORMAL});
+        }
+    }
+
+    // In double check only the king can move
+    if (checkers & (checkers - 1)) {
+        return;
+    }
+
+    // In single check the other pieces must capture the checker or block its line
+    Bitboard checkMask = ~0ULL;
+    if (checkers) {
+        checkMask = betweenBB[king][lsb(checkers)] | checkers;
+    } else if (type != GenType::CAPTURES) {
+        generateCastlingMoves<Us>(pos, king, moves);
+    }
+
+    for (int pieceType = typeIndex(PieceType::QUEEN); pieceType <= typeIndex(PieceType::KNIGHT); pieceType++) {
+        Bitboard pieces = own[pieceType];
+        while (pieces) {
+            int from = popLsb(pieces);
+            Bitboard attacks = 0;
+            switch (static_cast<PieceType>(pieceType)) {
+                case PieceType::QUEEN:  attacks = queenAttacks(from, pos.allPieces); break;
+                case PieceType::ROOK:   attacks = rookAttacks(from, pos.allPieces); break;
+                case PieceType::BISHOP: attacks = bishopAttacks(from, pos.allPieces); break;
+                case PieceType::KNIGHT: attacks = knightAttacks[from]; break;
+                default: break;
+            }
+            attacks &= targetSquares & checkMask;
+            // Pinned pieces may only slide along the pin ray
+            if (pinned & squareBB(from)) {
+                attacks &= lineBB[king][from];
+            }
+            while (attacks) {
+                moves.push_back({from, popLsb(attacks), PieceType::NONE, MoveFlag::NORMAL});
+            }
+        }
+    }
+
+    // Unpinned pawns are generated set-wise, pinned pawns one at a time along their pin ray
+    Bitboard pawns = own[typeIndex(PieceType::PAWN)];
+    generatePawnMoves<Us>(pos, pawns & ~pinned, checkMask, type, moves);
+    Bitboard pinnedPawns = pawns & pinned;
+    while (pinnedPawns) {
+        int from = popLsb(pinnedPawns);
+        generatePawnMoves<Us>(pos, squareBB(from), checkMask & lineBB[king][from], type, moves);
+    }
+}
+
+// Function to generate the legal moves of the side to move, all of them or only the captures or quiet moves
+void generateLegalMoves(const Position& pos, MoveList& moves, GenType type = GenType::ALL) {
+    if (pos.sideToMove == PieceColor::WHITE) {
+        generateLegalMoves<PieceColor::WHITE>(pos, moves, type);
+    } else {
+        generateLegalMoves<PieceColor::BLACK>(pos, moves, type);
+    }
+}
+
+// Function to allocate the transposition table with the given size in megabytes, clearing it
+void resizeTranspositionTable(TranspositionTable& tt, size_t megabytes) {
+    tt.bucketCount = max<size_t>(1, megabytes * 1024 * 1024 / sizeof(TTBucket));
+    tt.buckets.reset(new TTBucket[tt.bucketCount]);
+    tt.generation.store(0);
+}
+
+// Function to empty the transposition table
+void clearTranspositionTable(TranspositionTable& tt) {
+    for (size_t i = 0; i < tt.bucketCount; i++) {
+        for (TTEntry& entry : tt.buckets[i].entries) {
+            entry.keyXorData.store(0, memory_order_relaxed);
+            entry.data.store(0, memory_order_relaxed);
+        }
+    }
+    tt.generation.store(0);
+}
+
+// Function to start a new search generation so that entries from older searches get replaced first.
+// Returns the generation the search stamps on its entries; searches of other games may run at the same time
+uint8_t newTranspositionTableSearch(TranspositionTable& tt) {
+    return (tt.generation.fetch_add(1, memory_order_relaxed) + 1) & 63;
+}
+
+// Function to get the high 64 bits of the 128-bit product of two 64-bit numbers
+inline uint64_t mulHigh64(uint64_t a, uint64_t b) {
+#if defined(__SIZEOF_INT128__)
+    __extension__ typedef unsigned __int128 uint128;
+    return static_cast<uint64_t>((static_cast<uint128>(a) * b) >> 64);
+#else
+    // Multiply the 32-bit halves and add up the partial products with their carries
+    uint64_t aLow = a & 0xFFFFFFFFULL, aHigh = a >> 32;
+    uint64_t bLow = b & 0xFFFFFFFFULL, bHigh = b >> 32;
+    uint64_t low = aLow * bLow;
+    uint64_t middle1 = aHigh * bLow + (low >> 32);
+    uint64_t middle2 = aLow * bHigh + (middle1 & 0xFFFFFFFFULL);
+    return aHigh * bHigh + (middle1 >> 32) + (middle2 >> 32);
+#endif
+}
+
+// Function to find the bucket a key hashes to
+inline TTBucket& bucketFor(const TranspositionTable& tt, Key key) {
+    // Multiply-high maps the key onto any table size without a modulo
+    return tt.buckets[static_cast<size_t>(mulHigh64(key, tt.bucketCount))];
+}
+
+// Function to unpack the data word of an entry
+TTData unpackEntry(uint64_t data) {
+    TTData result;
+    result.move = Move(static_cast<uint16_t>(data));
+    result.score = static_cast<int16_t>(data >> 16);
+    result.depth = static_cast<int8_t>(data >> 32);
+    result.bound = static_cast<Bound>((data >> 40) & 3);
+    return result;
+}
+
+// Function to look a position up in the transposition table, returns false on a miss
+bool probeTranspositionTable(const TranspositionTable& tt, Key key, TTData& result) {
+    for (TTEntry& entry : bucketFor(tt, key).entries) {
+        uint64_t data = entry.data.load(memory_order_relaxed);
+        if ((entry.keyXorData.load(memory_order_relaxed) ^ data) == key && data != 0) {
+            result = unpackEntry(data);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Function to store a search result, replacing the shallowest or oldest entry of the bucket
+void storeTranspositionTable(TranspositionTable& tt, uint8_t generation, Key key, int depth, Bound bound, int score,
+                             const Move& move) {
+    TTBucket& bucket = bucketFor(tt, key);
+    TTEntry* replace = &bucket.entries[0];
+    int replaceWorth = 1 << 30;
+    uint64_t replaceData = 0;
+
+    for (TTEntry& entry : bucket.entries) {
+        uint64_t data = entry.data.load(memory_order_relaxed);
+        if (data == 0 || (entry.keyXorData.load(memory_order_relaxed) ^ data) == key) {
+            // Same position or an empty slot: always use it
+            replace = &entry;
+            replaceData = data;
+            break;
+        }
+        // Worth of keeping an entry: its depth, minus a penalty for each search generation it is old
+        int age = (generation - static_cast<int>(data >> 42)) & 63;
+        int worth = static_cast<int8_t>(data >> 32) - 8 * age;
+        if (worth < replaceWorth) {
+            replace = &entry;
+            replaceWorth = worth;
+            replaceData = data;
+        }
+    }
+
+    // Keep the old best move when the new result has none for the same position
+    uint16_t packed = move.packed;
+    if (packed == 0 && replaceData != 0 && (replace->keyXorData.load(memory_order_relaxed) ^ replaceData) == key) {
+        packed = static_cast<uint16_t>(replaceData);
+    }
+
+    uint64_t data = packed |
+                    (static_cast<uint64_t>(static_cast<uint16_t>(score)) << 16) |
+                    (static_cast<uint64_t>(static_cast<uint8_t>(depth)) << 32) |
+                    (static_cast<uint64_t>(bound) << 40) |
+                    (static_cast<uint64_t>(generation) << 42);
+    replace->keyXorData.store(key ^ data, memory_order_relaxed);
+    replace->data.store(data, memory_order_relaxed);
+}
+
+// Function to estimate how full the table is, in permille of entries written by the search of the given generation
+int hashfull(const TranspositionTable& tt, uint8_t generation) {
+    size_t sampleBuckets = min<size_t>(tt.bucketCount, 1000 / TT_BUCKET_SIZE);
+    int used = 0;
+    for (size_t i = 0; i < sampleBuckets; i++) {
+        for (const TTEntry& entry : tt.buckets[i].entries) {
+            uint64_t data = entry.data.load(memory_order_relaxed);
+            if (data != 0 && static_cast<int>(data >> 42) == generation) {
+                used++;
+            }
+        }
+    }
+    return sampleBuckets ? static_cast<int>(used * 1000 / (sampleBuckets * TT_BUCKET_SIZE)) : 0;
+}
+
+// Piece values in centipawns, indexed by PieceType
+const int pieceValues[6] = {0, 900, 500, 330, 320, 100};
+
+// Middlegame and endgame piece values in centipawns, indexed by PieceType
+const int materialMg[6] = {0, 1025, 477, 365, 337, 82};
+const int materialEg[6] = {0, 936, 512, 297, 281, 94};
+
+// Middlegame and endgame piece-square tables from white's point of view, indexed by PieceType and
+// laid out as seen from white's side: the first row is rank 8 (values from the PeSTO evaluation)
+const int pieceSquareMg[6][NUM_SQUARES] = {
+    { // King
+        -65,  23,  16, -15, -56, -34,   2,  13,
+         29,  -1, -20,  -7,  -8,  -4, -38, -29,
+         -9,  24,   2, -16, -20,   6,  22, -22,
+        -17, -20, -12, -27, -30, -25, -14, -36,
+        -49,  -1, -27, -39, -46, -44, -33, -51,
+        -14, -14, -22, -46, -44, -30, -15, -27,
+          1,   7,  -8, -64, -43, -16,   9,   8,
+        -15,  36,  12, -54,   8, -28,  24,  14,
+    },
+    { // Queen
+        -28,   0,  29,  12,  59,  44,  43,  45,
+        -24, -39,  -5,   1, -16,  57,  28,  54,
+        -13, -17,   7,   8,  29,  56,  47,  57,
+        -27, -27, -16, -16,  -1,  17,  -2,   1,
+         -9, -26,  -9, -10,  -2,  -4,   3,  -3,
+        -14,   2, -11,  -2,  -5,   2,  14,   5,
+        -35,  -8,  11,   2,   8,  15,  -3,   1,
+         -1, -18,  -9,  10, -15, -25, -31, -50,
+    },
+    { // Rook
+         32,  42,  32,  51,  63,   9,  31,  43,
+         27,  32,  58,  62,  80,  67,  26,  44,
+         -5,  19,  26,  36,  17,  45,  61,  16,
+        -24, -11,   7,  26,  24,  35,  -8, -20,
+        -36, -26, -12,  -1,   9,  -7,   6, -23,
+        -45, -25, -16, -17,   3,   0,  -5, -33,
+        -44, -16, -20,  -9,  -1,  11,  -6, -71,
+        -19, -13,   1,  17,  16,   7, -37, -26,
+    },
+    { // Bishop
+        -29,   4, -82, -37, -25, -42,   7,  -8,
+        -26,  16, -18, -13,  30,  59,  18, -47,
+        -16,  37,  43,  40,  35,  50,  37,  -2,
+         -4,   5,  19,  50,  37,  37,   7,  -2,
+         -6,  13,  13,  26,  34,  12,  10,   4,
+          0,  15,  15,  15,  14,  27,  18,  10,
+          4,  15,  16,   0,   7,  21,  33,   1,
+        -33,  -3, -14, -21, -13, -12, -39, -21,
+    },
+    { // Knight
+       -167, -89, -34, -49,  61, -97, -15,-107,
+        -73, -41,  72,  36,  23,  62,   7, -17,
+        -47,  60,  37,  65,  84, 129,  73,  44,
+         -9,  17,  19,  53,  37,  69,  18,  22,
+        -13,   4,  16,  13,  28,  19,  21,  -8,
+        -23,  -9,  12,  10,  19,  17,  25, -16,
+        -29, -53, -12,  -3,  -1,  18, -14, -19,
+       -105, -21, -58, -33, -17, -28, -19, -23,
+    },
+    { // Pawn
+          0,   0,   0,   0,   0,   0,   0,   0,
+         98, 134,  61,  95,  68, 126,  34, -11,
+         -6,   7,  26,  31,  65,  56,  25, -20,
+        -14,  13,   6,  21,  23,  12,  17, -23,
+        -27,  -2,  -5,  12,  17,   6,  10, -25,
+        -26,  -4,  -4, -10,   3,   3,  33, -12,
+        -35,  -1, -20, -23, -15,  24,  38, -22,
+          0,   0,   0,   0,   0,   0,   0,   0,
+    },
+};
+const int pieceSquareEg[6][NUM_SQUARES] = {
+    { // King
+        -74, -35, -18, -18, -11,  15,   4, -17,
+        -12,  17,  14,  17,  17,  38,  23,  11,
+         10,  17,  23,  15,  20,  45,  44,  13,
+         -8,  22,  24,  27,  26,  33,  26,   3,
+        -18,  -4,  21,  24,  27,  23,   9, -11,
+        -19,  -3,  11,  21,  23,  16,   7,  -9,
+        -27, -11,   4,  13,  14,   4,  -5, -17,
+        -53, -34, -21, -11, -28, -14, -24, -43,
+    },
+    { // Queen
+         -9,  22,  22,  27,  27,  19,  10,  20,
+        -17,  20,  32,  41,  58,  25,  30,   0,
+        -20,   6,   9,  49,  47,  35,  19,   9,
+          3,  22,  24,  45,  57,  40,  57,  36,
+        -18,  28,  19,  47,  31,  34,  39,  23,
+        -16, -27,  15,   6,   9,  17,  10,   5,
+        -22, -23, -30, -16, -16, -23, -36, -32,
+        -33, -28, -22, -43,  -5, -32, -20, -41,
+    },
+    { // Rook
+         13,  10,  18,  15,  12,  12,   8,   5,
+         11,  13,  13,  11,  -3,   3,   8,   3,
+          7,   7,   7,   5,   4,  -3,  -5,  -3,
+          4,   3,  13,   1,   2,   1,  -1,   2,
+          3,   5,   8,   4,  -5,  -6,  -8, -11,
+         -4,   0,  -5,  -1,  -7, -12,  -8, -16,
+         -6,  -6,   0,   2,  -9,  -9, -11,  -3,
+         -9,   2,   3,  -1,  -5, -13,   4, -20,
+    },
+    { // Bishop
+        -14, -21, -11,  -8,  -7,  -9, -17, -24,
+         -8,  -4,   7, -12,  -3, -13,  -4, -14,
+          2,  -8,   0,  -1,  -2,   6,   0,   4,
+         -3,   9,  12,   9,  14,  10,   3,   2,
+         -6,   3,  13,  19,   7,  10,  -3,  -9,
+        -12,  -3,   8,  10,  13,   3,  -7, -15,
+        -14, -18,  -7,  -1,   4,  -9, -15, -27,
+        -23,  -9, -23,  -5,  -9, -16,  -5, -17,
+    },
+    { // Knight
+        -58, -38, -13, -28, -31, -27, -63, -99,
+        -25,  -8, -25,  -2,  -9, -25, -24, -52,
+        -24, -20,  10,   9,  -1,  -9, -19, -41,
+        -17,   3,  22,  22,  22,  11,   8, -18,
+        -18,  -6,  16,  25,  16,  17,   4, -18,
+        -23,  -3,  -1,  15,  10,  -3, -20, -22,
+        -42, -20, -10,  -5,  -2, -20, -23, -44,
+        -29, -51, -23, -15, -22, -18, -50, -64,
+    },
+    { // Pawn
+          0,   0,   0,   0,   0,   0,   0,   0,
+        178, 173, 158, 134, 147, 132, 165, 187,
+         94, 100,  85,  67,  56,  53,  82,  84,
+         32,  24,  13,   5,  -2,   4,  17,  17,
+         13,   9,  -3,  -7,  -7,  -8,   3,  -1,
+          4,   7,  -6,   1,   0,  -5,  -1,  -8,
+         13,   8,   8,  10,  13,   0,   2,  -7,
+          0,   0,   0,   0,   0,   0,   0,   0,
+    },
+};
+
+// Function to get the index of a square in the piece-square tables: white reads them upside down since
+// their first row is rank 8, black reads them as they are, which mirrors them onto its own side
+inline int pieceSquareIndex(PieceColor color, int square) {
+    return color == PieceColor::WHITE ? square ^ 56 : square;
+}
+
+// Function to fill the combined material and piece-square tables used for incremental evaluation
+void initializeEvaluation() {
+    for (int type = 0; type < 6; type++) {
+        for (int square = 0; square < NUM_SQUARES; square++) {
+            int white = pieceSquareIndex(PieceColor::WHITE, square);
+            int black = pieceSquareIndex(PieceColor::BLACK, square);
+            psqTableMg[colorIndex(PieceColor::WHITE)][type][square] = materialMg[type] + pieceSquareMg[type][white];
+            psqTableEg[colorIndex(PieceColor::WHITE)][type][square] = materialEg[type] + pieceSquareEg[type][white];
+            psqTableMg[colorIndex(PieceColor::BLACK)][type][square] = -(materialMg[type] + pieceSquareMg[type][black]);
+            psqTableEg[colorIndex(PieceColor::BLACK)][type][square] = -(materialEg[type] + pieceSquareEg[type][black]);
+        }
+    }
+}
+
+// Function to blend a middlegame and an endgame score by the game phase
+inline int taperedScore(int mg, int eg, int phase) {
+    phase = min(phase, MAX_PHASE);
+    return (mg * phase + eg * (MAX_PHASE - phase)) / MAX_PHASE;
+}
+
+// Pawn structure terms, each scored per color in the middlegame and the endgame
+enum PawnTerm { PASSED, ISOLATED, DOUBLED, BACKWARD, SHIELD, PAWN_TERM_COUNT };
+const char* pawnTermNames[PAWN_TERM_COUNT] = {"Passed pawns", "Isolated pawns", "Doubled pawns", "Backward pawns", "Pawn shield"};
+
+// Passed pawn bonus by rank, counted from the pawn's own side
+const int passedBonusMg[BOARD_SIZE] = {0, 0, 5, 10, 20, 35, 60, 0};
+const int passedBonusEg[BOARD_SIZE] = {0, 5, 10, 20, 40, 70, 110, 0};
+
+// Pawn weakness penalties, and the bonus of a pawn one or two ranks in front of its king
+const int ISOLATED_MG = -10, ISOLATED_EG = -15;
+const int DOUBLED_MG = -10, DOUBLED_EG = -25;
+const int BACKWARD_MG = -8, BACKWARD_EG = -12;
+const int SHIELD_NEAR_MG = 15, SHIELD_FAR_MG = 8;
+
+// Function to get the squares of the files next to a file
+inline Bitboard adjacentFilesBB(int file) {
+    Bitboard fileBB = FILE_A_BB << file;
+    return ((fileBB & ~FILE_A_BB) >> 1) | ((fileBB & ~FILE_H_BB) << 1);
+}
+
+// Function to get the squares on the ranks in front of a rank, as seen from a color's side
+inline Bitboard forwardRanksBB(PieceColor color, int rank) {
+    if (color == PieceColor::WHITE) {
+        return rank == BOARD_SIZE - 1 ? 0 : ~0ULL << (BOARD_SIZE * (rank + 1));
+    }
+    return (1ULL << (BOARD_SIZE * rank)) - 1;
+}
+
+// Function to score the pawn structure of one color, adding each term but the shield into terms[term][mg/eg]
+void scorePawns(const Position& pos, PieceColor color, int terms[PAWN_TERM_COUNT][2]) {
+    bool white = color == PieceColor::WHITE;
+    Bitboard ownPawns = pos.pieces[colorIndex(color)][typeIndex(PieceType::PAWN)];
+    Bitboard enemyPawns = pos.pieces[colorIndex(oppositeColor(color))][typeIndex(PieceType::PAWN)];
+
+    Bitboard pawns = ownPawns;
+    while (pawns) {
+        int square = popLsb(pawns);
+        int file = fileOf(square);
+        int rank = rankOf(square);
+        Bitboard fileBB = FILE_A_BB << file;
+        Bitboard adjacent = adjacentFilesBB(file);
+        Bitboard forward = forwardRanksBB(color, rank);
+
+        // Passed: no enemy pawn ahead on its own or a neighbouring file can stop it
+        if (!(enemyPawns & (fileBB | adjacent) & forward)) {
+            int relativeRank = white ? rank : BOARD_SIZE - 1 - rank;
+            terms[PASSED][0] += passedBonusMg[relativeRank];
+            terms[PASSED][1] += passedBonusEg[relativeRank];
+        }
+        // Doubled: the rear pawn of a file is the one penalized
+        if (ownPawns & fileBB & forward) {
+            terms[DOUBLED][0] += DOUBLED_MG;
+            terms[DOUBLED][1] += DOUBLED_EG;
+        }
+        if (!(ownPawns & adjacent)) {
+            // Isolated: no friendly pawn on either neighbouring file
+            terms[ISOLATED][0] += ISOLATED_MG;
+            terms[ISOLATED][1] += ISOLATED_EG;
+        } else if (!(ownPawns & adjacent & ~forward)) {
+            // Backward: every neighbour has advanced past it and an enemy pawn guards the square in front
+            int stop = square + (white ? BOARD_SIZE : -BOARD_SIZE);
+            if (isValidSquare(stop) && (pawnAttacks[colorIndex(color)][stop] & enemyPawns)) {
+                terms[BACKWARD][0] += BACKWARD_MG;
+                terms[BACKWARD][1] += BACKWARD_EG;
+            }
+        }
+    }
+}
+
+// Function to score the pawn shield of one color's king: own pawns on the king's file and its neighbours,
+// one or two ranks in front of it. It depends on the king, so it is scored at every evaluation instead of
+// being kept in the pawn hash table
+int scoreKingShield(const Position& pos, PieceColor color) {
+    int king = kingSquare(pos, color);
+    if (king == NO_SQUARE) {
+        return 0;
+    }
+    Bitboard ownPawns = pos.pieces[colorIndex(color)][typeIndex(PieceType::PAWN)];
+    Bitboard files = (FILE_A_BB << fileOf(king)) | adjacentFilesBB(fileOf(king));
+    int step = color == PieceColor::WHITE ? BOARD_SIZE : -BOARD_SIZE;
+    Bitboard nearRank = isValidSquare(king + step) ? RANK_1_BB << (BOARD_SIZE * rankOf(king + step)) : 0;
+    Bitboard farRank = isValidSquare(king + 2 * step) ? RANK_1_BB << (BOARD_SIZE * rankOf(king + 2 * step)) : 0;
+    return SHIELD_NEAR_MG * popCount(ownPawns & files & nearRank) + SHIELD_FAR_MG * popCount(ownPawns & files & farRank);
+}
+
+// Function to get the pawn structure score of a position, from the pawn hash table when it has been seen before
+const PawnEntry& probePawns(PawnTable& table, const Position& pos) {
+    PawnEntry& entry = table.entries[pos.pawnKey & (PAWN_TABLE_SIZE - 1)];
+    table.probes.store(table.probes.load(memory_order_relaxed) + 1, memory_order_relaxed);
+    if (entry.key == pos.pawnKey) {
+        table.hits.store(table.hits.load(memory_order_relaxed) + 1, memory_order_relaxed);
+        return entry;
+    }
+
+    int terms[2][PAWN_TERM_COUNT][2] = {};
+    scorePawns(pos, PieceColor::WHITE, terms[colorIndex(PieceColor::WHITE)]);
+    scorePawns(pos, PieceColor::BLACK, terms[colorIndex(PieceColor::BLACK)]);
+    entry.key = pos.pawnKey;
+    entry.mgScore = 0;
+    entry.egScore = 0;
+    for (int term = 0; term < PAWN_TERM_COUNT; term++) {
+        entry.mgScore += terms[colorIndex(PieceColor::WHITE)][term][0] - terms[colorIndex(PieceColor::BLACK)][term][0];
+        entry.egScore += terms[colorIndex(PieceColor::WHITE)][term][1] - terms[colorIndex(PieceColor::BLACK)][term][1];
+    }
+    return entry;
+}
+
+// Kernels to compute the NNUE output layer: the clipped hidden layer of each side (bias added, clamped
+// to 0..QA) dotted with its output weights, in plain C++ and with SSE4.1 and AVX2
+int nnueOutputScalar(const int16_t* us, const int16_t* them) {
+    int sum = 0;
+    for (int side = 0; side < 2; side++) {
+        const int16_t* acc = side == 0 ? us : them;
+        for (int i = 0; i < NNUE_HIDDEN; i++) {
+            int value = max(0, min(NNUE_QA, acc[i] + nnueWeights.featureBias[i]));
+            sum += value * nnueWeights.outputWeights[side][i];
+        }
+    }
+    return sum;
+}
+
+#ifdef HAS_SIMD_SUPPORT
+__attribute__((target("sse4.1"))) int nnueOutputSse41(const int16_t* us, const int16_t* them) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i qa = _mm_set1_epi16(NNUE_QA);
+    __m128i sum = _mm_setzero_si128();
+    for (int side = 0; side < 2; side++) {
+        const int16_t* acc = side == 0 ? us : them;
+        for (int i = 0; i < NNUE_HIDDEN; i += 8) {
+            __m128i value = _mm_adds_epi16(_mm_load_si128(reinterpret_cast<const __m128i*>(acc + i)),
+                                           _mm_load_si128(reinterpret_cast<const __m128i*>(nnueWeights.featureBias + i)));
+            value = _mm_min_epi16(_mm_max_epi16(value, zero), qa);
+            __m128i weights = _mm_load_si128(reinterpret_cast<const __m128i*>(nnueWeights.outputWeights[side] + i));
+            sum = _mm_add_epi32(sum, _mm_madd_epi16(value, weights));
+        }
+    }
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4E));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xB1));
+    return _mm_cvtsi128_si32(sum);
+}
+
+__attribute__((target("avx2"))) int nnueOutputAvx2(const int16_t* us, const int16_t* them) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i qa = _mm256_set1_epi16(NNUE_QA);
+    __m256i sum = _mm256_setzero_si256();
+    for (int side = 0; side < 2; side++) {
+        const int16_t* acc = side == 0 ? us : them;
+        for (int i = 0; i < NNUE_HIDDEN; i += 16) {
+            __m256i value = _mm256_adds_epi16(_mm256_load_si256(reinterpret_cast<const __m256i*>(acc + i)),
+                                              _mm256_load_si256(reinterpret_cast<const __m256i*>(nnueWeights.featureBias + i)));
+            value = _mm256_min_epi16(_mm256_max_epi16(value, zero), qa);
+            __m256i weights = _mm256_load_si256(reinterpret_cast<const __m256i*>(nnueWeights.outputWeights[side] + i));
+            sum = _mm256_add_epi32(sum, _mm256_madd_epi16(value, weights));
+        }
+    }
+    __m128i half = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+    half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0x4E));
+    half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0xB1));
+    return _mm_cvtsi128_si32(half);
+}
+#endif
+
+// Function to evaluate a position with the network from the side to move's point of view
+int nnueEvaluate(const Position& pos, const StateStack& states) {
+    const int16_t* us = states.accumulator[colorIndex(pos.sideToMove)];
+    const int16_t* them = states.accumulator[colorIndex(oppositeColor(pos.sideToMove))];
+    int output;
+#ifdef HAS_SIMD_SUPPORT
+    if (simdLevel == SimdLevel::AVX2) {
+        output = nnueOutputAvx2(us, them);
+    } else if (simdLevel == SimdLevel::SSE41) {
+        output = nnueOutputSse41(us, them);
+    } else
+#endif
+    {
+        output = nnueOutputScalar(us, them);
+    }
+    // Keep network scores clear of the mate scores
+    int score = static_cast<int>((static_cast<int64_t>(output) + nnueWeights.outputBias) * NNUE_SCALE / (NNUE_QA * NNUE_QB));
+    return max(-MATE_BOUND + 1, min(MATE_BOUND - 1, score));
+}
+
+// Function to load a network from a file of little-endian int16 values: the feature weights (input by
+// input), the feature biases, the output weights (side to move's half first) and the output bias.
+// Returns false, leaving the hand-written evaluation in use, if the file is missing or the wrong size
+bool loadNetwork(const string& path) {
+    ifstream file(path, ios::binary | ios::ate);
+    const streamsize expected = sizeof(nnueWeights.featureWeights) + sizeof(nnueWeights.featureBias) +
+                                sizeof(nnueWeights.outputWeights) + sizeof(nnueWeights.outputBias);
+    if (!file || file.tellg() != expected) {
+        return false;
+    }
+    file.seekg(0);
+    file.read(reinterpret_cast<char*>(nnueWeights.featureWeights), sizeof(nnueWeights.featureWeights));
+    file.read(reinterpret_cast<char*>(nnueWeights.featureBias), sizeof(nnueWeights.featureBias));
+    file.read(reinterpret_cast<char*>(nnueWeights.outputWeights), sizeof(nnueWeights.outputWeights));
+    file.read(reinterpret_cast<char*>(&nnueWeights.outputBias), sizeof(nnueWeights.outputBias));
+    if (!file) {
+        return false;
+    }
+
+#ifdef HAS_SIMD_SUPPORT
+    simdLevel = __builtin_cpu_supports("avx2") ? SimdLevel::AVX2
+              : __builtin_cpu_supports("sse4.1") ? SimdLevel::SSE41 : SimdLevel::SCALAR;
+#endif
+    useNnue = true;
+    return true;
+}
+
+// Function to evaluate a position from the side to move's point of view without the network, using the
+// material and piece-square scores that doMove and undoMove keep up to date plus the cached pawn structure score
+int classicalEvaluate(const Position& pos, PawnTable& pawnTable) {
+    const PawnEntry& pawns = probePawns(pawnTable, pos);
+    int shield = scoreKingShield(pos, PieceColor::WHITE) - scoreKingShield(pos, PieceColor::BLACK);
+    int score = taperedScore(pos.mgScore + pawns.mgScore + shield, pos.egScore + pawns.egScore, pos.phase);
+    return pos.sideToMove == PieceColor::WHITE ? score : -score;
+}
+
+// Function to evaluate a position from the side to move's point of view, with the network when one is loaded
+int evaluate(const Position& pos, const StateStack& states, PawnTable& pawnTable) {
+    return useNnue ? nnueEvaluate(pos, states) : classicalEvaluate(pos, pawnTable);
+}
+
+// Function to check the NNUE accumulators that doMove and undoMove keep up to date: every legal move is
+// made and taken back, comparing the accumulators with a refresh from scratch each time.
+// Returns the number of positions where they differ
+int checkAccumulators(const Position& rootPos) {
+    unique_ptr<StateStack> incremental(new StateStack());
+    unique_ptr<StateStack> refreshed(new StateStack());
+    Position pos = rootPos;
+    refreshAccumulators(pos, *incremental);
+    int mismatches = 0;
+    MoveList moves;
+    generateLegalMoves(pos, moves);
+    for (const Move& move : moves) {
+        doMove(pos, *incremental, move);
+        refreshAccumulators(pos, *refreshed);
+        mismatches += memcmp(incremental->accumulator, refreshed->accumulator, sizeof(refreshed->accumulator)) != 0;
+        undoMove(pos, *incremental);
+        refreshAccumulators(pos, *refreshed);
+        mismatches += memcmp(incremental->accumulator, refreshed->accumulator, sizeof(refreshed->accumulator)) != 0;
+    }
+    return mismatches;
+}
+
+// Function to print every term of the evaluation, recomputed from scratch, next to the incremental result
+void traceEvaluation(const Position& pos) {
+    const char* names[6] = {"King", "Queen", "Rook", "Bishop", "Knight", "Pawn"};
+    int totalMg = 0;
+    int totalEg = 0;
+    int phase = 0;
+    cout << "Term            White MG  White EG  Black MG  Black EG  Total MG  Total EG" << endl;
+    for (int type = 0; type < 6; type++) {
+        // Material and placement are shown as separate rows for each piece type
+        int material[2][2] = {};
+        int placement[2][2] = {};
+        for (int color = 0; color < 2; color++) {
+            Bitboard pieces = pos.pieces[color][type];
+            while (pieces) {
+                int index = pieceSquareIndex(static_cast<PieceColor>(color), popLsb(pieces));
+                material[color][0] += materialMg[type];
+                material[color][1] += materialEg[type];
+                placement[color][0] += pieceSquareMg[type][index];
+                placement[color][1] += pieceSquareEg[type][index];
+                phase += phaseWeights[type];
+            }
+        }
+        for (int row = 0; row < 2; row++) {
+            int (&term)[2][2] = row == 0 ? material : placement;
+            int mg = term[0][0] - term[1][0];
+            int eg = term[0][1] - term[1][1];
+            totalMg += mg;
+            totalEg += eg;
+            cout << left << setw(16) << (string(names[type]) + (row == 0 ? " material" : " squares")) << right
+                 << setw(8) << term[0][0] << setw(10) << term[0][1] << setw(10) << term[1][0] << setw(10) << term[1][1]
+                 << setw(10) << mg << setw(10) << eg << endl;
+        }
+    }
+
+    // Pawn structure terms, scored from scratch rather than read from the pawn hash table
+    int pawnTerms[2][PAWN_TERM_COUNT][2] = {};
+    scorePawns(pos, PieceColor::WHITE, pawnTerms[colorIndex(PieceColor::WHITE)]);
+    scorePawns(pos, PieceColor::BLACK, pawnTerms[colorIndex(PieceColor::BLACK)]);
+    pawnTerms[colorIndex(PieceColor::WHITE)][SHIELD][0] = scoreKingShield(pos, PieceColor::WHITE);
+    pawnTerms[colorIndex(PieceColor::BLACK)][SHIELD][0] = scoreKingShield(pos, PieceColor::BLACK);
+    for (int term = 0; term < PAWN_TERM_COUNT; term++) {
+        const int (&white)[2] = pawnTerms[colorIndex(PieceColor::WHITE)][term];
+        const int (&black)[2] = pawnTerms[colorIndex(PieceColor::BLACK)][term];
+        int mg = white[0] - black[0];
+        int eg = white[1] - black[1];
+        totalMg += mg;
+        totalEg += eg;
+        cout << left << setw(16) << pawnTermNames[term] << right
+             << setw(8) << white[0] << setw(10) << white[1] << setw(10) << black[0] << setw(10) << black[1]
+             << setw(10) << mg << setw(10) << eg << endl;
+    }
+
+    int score = taperedScore(totalMg, totalEg, phase);
+    cout << "Total MG/EG: " << totalMg << " / " << totalEg << endl;
+    cout << "Phase: " << min(phase, MAX_PHASE) << " / " << MAX_PHASE << endl;
+    cout << "Blended score (white's view): " << score << endl;
+    cout << "Evaluation (side to move): " << (pos.sideToMove == PieceColor::WHITE ? score : -score) << endl;
+    unique_ptr<PawnTable> pawnTable(new PawnTable());
+    cout << "Incremental evaluation (side to move): " << classicalEvaluate(pos, *pawnTable) << endl;
+
+    if (useNnue) {
+        const char* kernels[3] = {"scalar", "SSE4.1", "AVX2"};
+        unique_ptr<StateStack> states(new StateStack());
+        refreshAccumulators(pos, *states);
+        cout << "NNUE kernel: " << kernels[static_cast<int>(simdLevel)] << endl;
+        cout << "NNUE evaluation (side to move): " << nnueEvaluate(pos, *states) << endl;
+        cout << "NNUE incremental accumulators: " << checkAccumulators(pos) << " mismatches in the legal moves" << endl;
+    }
+}
+
+// Function to work out the material a move wins or loses once every capture on its target square has been
+// played out, each side recapturing with its least valuable piece and free to stop when that would lose.
+// Sliders uncovered behind a capturing piece join in (x-rays); the board itself is never changed
+int staticExchange(const Position& pos, const Move& move) {
+    if (move.flag() == MoveFlag::CASTLING) {
+        return 0;
+    }
+    int to = move.to();
+    PieceColor side = pieceAt(pos, move.from()).color();
+    PieceType attacker = pieceAt(pos, move.from()).type();
+    Bitboard occupied = pos.allPieces ^ squareBB(move.from());
+
+    // gain[d] is the material won by the side making capture d, if the other side stopped there
+    int gain[32];
+    if (move.flag() == MoveFlag::EN_PASSANT) {
+        gain[0] = pieceValues[typeIndex(PieceType::PAWN)];
+        occupied ^= squareBB(makeSquare(fileOf(to), rankOf(move.from())));
+    } else {
+        gain[0] = (pos.allPieces & squareBB(to)) ? pieceValues[typeIndex(pieceAt(pos, to).type())] : 0;
+    }
+    if (move.flag() == MoveFlag::PROMOTION) {
+        gain[0] += pieceValues[typeIndex(move.promotion())] - pieceValues[typeIndex(PieceType::PAWN)];
+        attacker = move.promotion();
+    }
+
+    Bitboard bishops = pos.pieces[0][typeIndex(PieceType::BISHOP)] | pos.pieces[1][typeIndex(PieceType::BISHOP)] |
+                       pos.pieces[0][typeIndex(PieceType::QUEEN)] | pos.pieces[1][typeIndex(PieceType::QUEEN)];
+    Bitboard rooks = pos.pieces[0][typeIndex(PieceType::ROOK)] | pos.pieces[1][typeIndex(PieceType::ROOK)] |
+                     pos.pieces[0][typeIndex(PieceType::QUEEN)] | pos.pieces[1][typeIndex(PieceType::QUEEN)];
+    Bitboard attackers = (attackersTo(pos, to, PieceColor::WHITE, occupied) |
+                          attackersTo(pos, to, PieceColor::BLACK, occupied)) & occupied;
+
+    int depth = 0;
+    while (true) {
+        side = oppositeColor(side);
+        Bitboard ownAttackers = attackers & pos.occupied[colorIndex(side)];
+        if (!ownAttackers) {
+            break;
+        }
+
+        // Least valuable attacker first: pawn, knight, bishop, rook, queen, king
+        int type = typeIndex(PieceType::PAWN);
+        while (!(ownAttackers & pos.pieces[colorIndex(side)][type])) {
+            type--;
+        }
+        // The king may only recapture when the square is no longer defended
+        if (type == typeIndex(PieceType::KING) && (attackers & pos.occupied[colorIndex(oppositeColor(side))])) {
+            break;
+        }
+
+        depth++;
+        gain[depth] = pieceValues[typeIndex(attacker)] - gain[depth - 1];
+        attacker = static_cast<PieceType>(type);
+        occupied ^= squareBB(lsb(ownAttackers & pos.pieces[colorIndex(side)][type]));
+
+        // Removing the capturing piece may uncover a slider behind it
+        attackers |= (bishopAttacks(to, occupied) & bishops) | (rookAttacks(to, occupied) & rooks);
+        attackers &= occupied;
+    }
+
+    // Walk back up the sequence: each side only makes its capture if that does not lose material
+    while (depth > 0) {
+        gain[depth - 1] = -max(-gain[depth - 1], gain[depth]);
+        depth--;
+    }
+    return gain[0];
+}
+
+// Function to check for a draw by the fifty-move rule or by repetition
+bool isDraw(const Position& pos, const StateStack& states) {
+    if (pos.halfmoveClock >= 100) {
+        return true;
+    }
+    // Only positions since the last capture or pawn move can repeat, and only with the same side to move
+    int lookback = min(pos.halfmoveClock, states.size);
+    for (int i = 4; i <= lookback; i += 2) {
+        if (states.entries[states.size - i].key == pos.key) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Function to convert a mate score to be relative to the current node before storing it
+int scoreToTT(int score, int ply) {
+    return score >= MATE_BOUND ? score + ply : score <= -MATE_BOUND ? score - ply : score;
+}
+
+// Function to convert a stored mate score back to be relative to the root
+int scoreFromTT(int score, int ply) {
+    return score >= MATE_BOUND ? score - ply : score <= -MATE_BOUND ? score + ply : score;
+}
+
+// Function to work out the soft and hard deadlines of a search from its limits
+void initializeTimeManager(TimeManager& time, const SearchLimits& limits) {
+    time = TimeManager();
+    if (limits.moveTime > 0) {
+        time.softLimit = time.hardLimit = limits.moveTime;
+        time.fixedTime = true;
+        return;
+    }
+    if (limits.timeLeft <= 0) {
+        return; // No clock: only the depth limit applies
+    }
+
+    // Share the clock evenly over the moves left, plus most of the increment
+    int usable = max(1, limits.timeLeft - MOVE_OVERHEAD_MS);
+    int movesToGo = limits.movesToGo > 0 ? min(limits.movesToGo, 50) : DEFAULT_MOVES_TO_GO;
+    int share = usable / movesToGo + limits.increment * 3 / 4;
+    time.softLimit = max(1, min(share, usable));
+
+    // Unstable searches may run over the target, but never use more than three quarters of the clock
+    // unless this is the last move before the time control
+    int ceiling = (movesToGo == 1) ? usable : max(time.softLimit, usable * 3 / 4);
+    time.hardLimit = min(time.softLimit * 4, ceiling);
+}
+
+// Function to get the milliseconds since the search started
+inline int elapsedTime(const SearchWorker& worker) {
+    return static_cast<int>(chrono::duration_cast<chrono::milliseconds>(
+        chrono::steady_clock::now() - worker.startTime).count());
+}
+
+// Function to decide after a completed iteration whether there is time for another one.
+// A best move that keeps changing or a falling score extends the target, a stable one cuts it short
+bool timeForNextIteration(TimeManager& time, const Move& bestMove, int score, int depth, int elapsed) {
+    if (depth > 1 && sameMove(bestMove, time.lastBestMove)) {
+        time.bestMoveStability++;
+    } else {
+        time.bestMoveStability = 0;
+    }
+    int scoreDrop = time.lastScore - score;
+    time.lastBestMove = bestMove;
+    time.lastScore = score;
+
+    if (time.softLimit == 0 || time.fixedTime) {
+        return true;
+    }
+    const double stabilityScale[4] = {1.6, 1.1, 0.8, 0.6};
+    double scale = stabilityScale[min(time.bestMoveStability, 3)];
+    if (depth > 1 && scoreDrop > 30) {
+        scale *= 1.3;
+    }
+    // The next iteration takes a few times longer than this one, so only start it early enough to finish
+    return elapsed < time.softLimit * scale * 0.6;
+}
+
+// Function to check the clock, stopping every search thread at the hard deadline
+void checkTime(SearchWorker& worker) {
+    if (worker.time.hardLimit > 0 && elapsedTime(worker) >= worker.time.hardLimit) {
+        worker.stop->store(true, memory_order_relaxed);
+    }
+}
+
+// Function to check if the search has been told to stop
+inline bool isStopped(const SearchWorker& worker) {
+    return worker.stop->load(memory_order_relaxed);
+}
+
+// History scores saturate at plus or minus this value
+const int MAX_HISTORY = 1 << 14;
+
+// Most quiet moves remembered per node for the history penalty
+const int MAX_QUIETS_TRIED = 64;
+
+// Function to check if a move captures a piece
+inline bool isCapture(const Position& pos, const Move& move) {
+    return move.flag() == MoveFlag::EN_PASSANT ||
+           (pos.occupied[colorIndex(oppositeColor(pos.sideToMove))] & squareBB(move.to()));
+}
+
+// Function to check if a move is quiet, that is neither a capture nor a promotion
+inline bool isQuiet(const Position& pos, const Move& move) {
+    return move.flag() != MoveFlag::PROMOTION && !isCapture(pos, move);
+}
+
+// Function to check if a capture loses material, only playing out the exchange when the attacker is worth more
+// than what it takes
+inline bool isLosingCapture(const Position& pos, const Move& move) {
+    if (move.flag() == MoveFlag::EN_PASSANT) {
+        return false;
+    }
+    if (move.flag() == MoveFlag::PROMOTION) {
+        return staticExchange(pos, move) < 0;
+    }
+    int victim = pieceValues[typeIndex(pieceAt(pos, move.to()).type())];
+    return pieceValues[typeIndex(pieceAt(pos, move.from()).type())] > victim && staticExchange(pos, move) < 0;
+}
+
+// Stages of the move picker, in the order their moves are handed out
+enum class PickStage { HASH_MOVE, GENERATE_CAPTURES, CAPTURES, KILLERS, GENERATE_QUIETS, QUIETS, BAD_CAPTURES, DONE };
+
+// Structure to hand out the moves of a node one at a time, generating each stage only once it is reached
+struct MovePicker {
+    PickStage stage;
+    Move ttMove;
+    Move killers[2];
+    int killerIndex;
+    MoveList moves;
+    int scores[MAX_MOVES];
+    int index;
+    MoveList badCaptures;
+    int badIndex;
+};
+
+// Function to set up a move picker for the node at the given ply
+void initMovePicker(MovePicker& picker, const SearchWorker& worker, const Move& ttMove, int ply) {
+    picker.stage = PickStage::HASH_MOVE;
+    picker.ttMove = ttMove;
+    picker.killers[0] = worker.killers[ply][0];
+    picker.killers[1] = worker.killers[ply][1];
+    picker.killerIndex = 0;
+    picker.index = 0;
+    picker.badCaptures.clear();
+    picker.badIndex = 0;
+}
+
+// Function to score captures and promotions by most valuable victim, least valuable attacker
+void scoreCaptures(const Position& pos, const MoveList& moves, int scores[]) {
+    for (int i = 0; i < moves.size(); i++) {
+        const Move& move = moves[i];
+        int victim = 0;
+        if (move.flag() == MoveFlag::EN_PASSANT) {
+            victim = pieceValues[typeIndex(PieceType::PAWN)];
+        } else if (pos.allPieces & squareBB(move.to())) {
+            victim = pieceValues[typeIndex(pieceAt(pos, move.to()).type())];
+        }
+        if (move.flag() == MoveFlag::PROMOTION) {
+            victim += pieceValues[typeIndex(move.promotion())];
+        }
+        scores[i] = victim * 8 - pieceValues[typeIndex(pieceAt(pos, move.from()).type())] / 8;
+    }
+}
+
+// Function to score quiet moves by their history
+void scoreQuiets(const SearchWorker& worker, const MoveList& moves, int scores[]) {
+    const int (&history)[NUM_SQUARES][NUM_SQUARES] = worker.history[colorIndex(worker.pos.sideToMove)];
+    for (int i = 0; i < moves.size(); i++) {
+        scores[i] = history[moves[i].from()][moves[i].to()];
+    }
+}
+
+// Function to move the best scored move left in the list to the given index (incremental selection sort)
+void pickNextMove(MoveList& moves, int scores[], int index) {
+    int best = index;
+    for (int i = index + 1; i < moves.size(); i++) {
+        if (scores[i] > scores[best]) {
+            best = i;
+        }
+    }
+    swap(moves[index], moves[best]);
+    swap(scores[index], scores[best]);
+}
+
+// Function to get the next move to search, returns false once every legal move has been handed out
+bool nextMove(MovePicker& picker, const SearchWorker& worker, Move& move) {
+    const Position& pos = worker.pos;
+    while (true) {
+        switch (picker.stage) {
+            case PickStage::HASH_MOVE:
+                picker.stage = PickStage::GENERATE_CAPTURES;
+                if (isLegalMove(pos, picker.ttMove)) {
+                    move = picker.ttMove;
+                    return true;
+                }
+                picker.ttMove = Move();
+                break;
+
+            case PickStage::GENERATE_CAPTURES:
+                picker.moves.clear();
+                generateLegalMoves(pos, picker.moves, GenType::CAPTURES);
+                scoreCaptures(pos, picker.moves, picker.scores);
+                picker.index = 0;
+                picker.stage = PickStage::CAPTURES;
+                break;
+
+            case PickStage::CAPTURES:
+                while (picker.index < picker.moves.size()) {
+                    pickNextMove(picker.moves, picker.scores, picker.index);
+                    move = picker.moves[picker.index++];
+                    if (sameMove(move, picker.ttMove)) {
+                        continue;
+                    }
+                    // Captures that lose material wait until after the quiet moves
+                    if (isLosingCapture(pos, move)) {
+                        picker.badCaptures.push_back(move);
+                        continue;
+                    }
+                    return true;
+                }
+                picker.stage = PickStage::KILLERS;
+                break;
+
+            case PickStage::KILLERS:
+                while (picker.killerIndex < 2) {
+                    move = picker.killers[picker.killerIndex++];
+                    // A killer from a sibling node may be a capture here, or not be legal at all
+                    if (!sameMove(move, picker.ttMove) && isLegalMove(pos, move) && isQuiet(pos, move)) {
+                        return true;
+                    }
+                }
+                picker.stage = PickStage::GENERATE_QUIETS;
+                break;
+
+            case PickStage::GENERATE_QUIETS:
+                picker.moves.clear();
+                generateLegalMoves(pos, picker.moves, GenType::QUIETS);
+                scoreQuiets(worker, picker.moves, picker.scores);
+                picker.index = 0;
+                picker.stage = PickStage::QUIETS;
+                break;
+
+            case PickStage::QUIETS:
+                while (picker.index < picker.moves.size()) {
+                    pickNextMove(picker.moves, picker.scores, picker.index);
+                    move = picker.moves[picker.index++];
+                    // Skip the moves an earlier stage already handed out
+                    if (!sameMove(move, picker.ttMove) && !sameMove(move, picker.killers[0]) &&
+                        !sameMove(move, picker.killers[1])) {
+                        return true;
+                    }
+                }
+                picker.stage = PickStage::BAD_CAPTURES;
+                break;
+
+            case PickStage::BAD_CAPTURES:
+                if (picker.badIndex < picker.badCaptures.size()) {
+                    move = picker.badCaptures[picker.badIndex++];
+                    return true;
+                }
+                picker.stage = PickStage::DONE;
+                break;
+
+            case PickStage::DONE:
+                return false;
         }
-        cout << 8 - row << endl;
     }
-    cout << "  a b c d e f g h" << endl;
 }
 
-// Function to convert algebraic notation to board coordinates
-pair<int, int> convertAlgebraicToCoordinates(const string& position) {
-    if (position.size() != 2) return {-1, -1};
-    int col = colToIndex[position[0]];
-    int row = BOARD_SIZE - (position[1] - '0');
-    return {row, col};
+// Function to adjust a history entry, saturating towards plus or minus MAX_HISTORY
+inline void updateHistory(int& entry, int bonus) {
+    entry += bonus - entry * abs(bonus) / MAX_HISTORY;
 }
 
-// Function to convert board coordinates to algebraic notation
-string convertCoordinatesToAlgebraic(int row, int col) {
-    string result;
-    result += ('a' + col);
-    result += ('0' + (BOARD_SIZE - row));
-    return result;
-}
+// Function to reward the quiet move that caused a beta cutoff and penalize the quiet moves tried before it
+void updateQuietStats(SearchWorker& worker, const Move& move, const Move* quietsTried, int quietCount, int depth, int ply) {
+    if (!sameMove(move, worker.killers[ply][0])) {
+        worker.killers[ply][1] = worker.killers[ply][0];
+        worker.killers[ply][0] = move;
+    }
 
-// Function to check if a coordinate is valid
-bool isValidCoordinate(int x, int y) {
-    return x >= 0 && x < BOARD_SIZE && y >= 0 && y < BOARD_SIZE;
+    int (&history)[NUM_SQUARES][NUM_SQUARES] = worker.history[colorIndex(worker.pos.sideToMove)];
+    int bonus = min(depth * depth, 400);
+    updateHistory(history[move.from()][move.to()], bonus);
+    for (int i = 0; i < quietCount; i++) {
+        updateHistory(history[quietsTried[i].from()][quietsTried[i].to()], -bonus);
+    }
 }
 
-// Function to check if a move is within the board bounds
-bool isValidMove(int startX, int startY, int endX, int endY) {
-    return isValidCoordinate(startX, startY) && isValidCoordinate(endX, endY);
+// Function to count a node, polling the clock every few thousand nodes, returns false if the search must stop
+inline bool visitNode(SearchWorker& worker) {
+    uint64_t nodes = worker.nodes.load(memory_order_relaxed) + 1;
+    worker.nodes.store(nodes, memory_order_relaxed);
+    if (worker.threadId == 0 && (nodes & 2047) == 0) {
+        checkTime(worker);
+    }
+    return !isStopped(worker);
 }
 
-// Function to check if a square is under attack by an opponent's piece
-bool isUnderAttack(int x, int y, PieceColor attackingColor) {
-    // Check for attacks from opponent's pawns
-    int forwardDir = (attackingColor == PieceColor::WHITE) ? -1 : 1;
-    int pawnX[2] = {x - 1, x + 1};
-    for (int i = 0; i < 2; i++) {
-        int pawnY = y + forwardDir;
-        if (isValidCoordinate(pawnX[i], pawnY) &&
-            board[pawnY][pawnX[i]].type == PieceType::PAWN &&
-            board[pawnY][pawnX[i]].color == attackingColor) {
-            return true;
-        }
+// Captures that cannot lift the score to alpha even with this much positional gain on top are not searched
+const int DELTA_MARGIN = 200;
+
+// Function to search only captures and queen promotions below the horizon, so that leaves are evaluated
+// in quiet positions. The side to move may stand pat on the static evaluation unless it is in check, in
+// which case every evasion is searched
+int quiescence(SearchWorker& worker, int alpha, int beta, int ply) {
+    Position& pos = worker.pos;
+    worker.pvLength[ply] = ply;
+    if (!visitNode(worker)) {
+        return 0;
     }
 
-    // Check for attacks from opponent's knights
-    int knightX[8] = {x - 2, x - 2, x - 1, x - 1, x + 1, x + 1, x + 2, x + 2};
-    int knightY[8] = {y - 1, y + 1, y - 2, y + 2, y - 2, y + 2, y - 1, y + 1};
-    for (int i = 0; i < 8; i++) {
-        if (isValidCoordinate(knightX[i], knightY[i]) &&
-            board[knightY[i]][knightX[i]].type == PieceType::KNIGHT &&
-            board[knightY[i]][knightX[i]].color == attackingColor) {
-            return true;
+    int standPat = evaluate(pos, worker.states, worker.pawnTable);
+    if (ply >= MAX_PLY - 1) {
+        return standPat;
+    }
+    bool inCheck = isInCheck(pos, pos.sideToMove);
+    int bestScore = -INFINITE_SCORE;
+    if (!inCheck) {
+        if (standPat >= beta) {
+            return standPat;
         }
+        alpha = max(alpha, standPat);
+        bestScore = standPat;
     }
 
-    // Check for attacks from opponent's bishops and queens (diagonal attacks)
-    for (int dx = -1; dx <= 1; dx += 2) {
-        for (int dy = -1; dy <= 1; dy += 2) {
-            for (int dist = 1; dist < BOARD_SIZE; dist++) {
-                int bx = x + dx * dist;
-                int by = y + dy * dist;
-                if (!isValidCoordinate(bx, by)) {
-                    break; // Stop if out of board bounds
+    MoveList moves;
+    int scores[MAX_MOVES];
+    generateLegalMoves(pos, moves, inCheck ? GenType::ALL : GenType::CAPTURES);
+    if (inCheck && moves.empty()) {
+        return -MATE_SCORE + ply;
+    }
+    scoreCaptures(pos, moves, scores);
+
+    for (int i = 0; i < moves.size(); i++) {
+        pickNextMove(moves, scores, i);
+        const Move move = moves[i];
+        if (!inCheck) {
+            if (move.flag() == MoveFlag::PROMOTION) {
+                // Under-promotions almost never matter below the horizon
+                if (move.promotion() != PieceType::QUEEN) {
+                    continue;
                 }
-                if (board[by][bx].type == PieceType::NONE) {
-                    continue; // Empty square, keep checking
-                } else if (board[by][bx].color == attackingColor &&
-                           (board[by][bx].type == PieceType::BISHOP || board[by][bx].type == PieceType::QUEEN)) {
-                    return true; // Opponent's bishop or queen can attack this square
-                } else {
-                    break; // Reached a piece that blocks further diagonal movement
+            } else {
+                // Delta pruning: even winning the victim for free would leave us below alpha
+                int victim = move.flag() == MoveFlag::EN_PASSANT ? pieceValues[typeIndex(PieceType::PAWN)]
+                                                                 : pieceValues[typeIndex(pieceAt(pos, move.to()).type())];
+                if (standPat + victim + DELTA_MARGIN <= alpha) {
+                    continue;
                 }
             }
+            if (isLosingCapture(pos, move)) {
+                continue;
+            }
         }
-    }
 
-    // Check for attacks from opponent's rooks and queens (horizontal and vertical attacks)
-    for (int dir = -1; dir <= 1; dir += 2) {
-        for (int dist = 1; dist < BOARD_SIZE; dist++) {
-            int rx = x + dir * dist;
-            int ry = y;
-            if (!isValidCoordinate(rx, ry)) {
-                break; // Stop if out of board bounds
-            }
-            if (board[ry][rx].type == PieceType::NONE) {
-                continue; // Empty square, keep checking
-            } else if (board[ry][rx].color == attackingColor &&
-                       (board[ry][rx].type == PieceType::ROOK || board[ry][rx].type == PieceType::QUEEN)) {
-                return true; // Opponent's rook or queen can attack this square
-            } else {
-                break; // Reached a piece that blocks further horizontal/vertical movement
-            }
+        doMove(pos, worker.states, move);
+        int score = -quiescence(worker, -beta, -alpha, ply + 1);
+        undoMove(pos, worker.states);
+
+        if (isStopped(worker)) {
+            return 0;
         }
-        for (int dist = 1; dist < BOARD_SIZE; dist++) {
-            int rx = x;
-            int ry = y + dir * dist;
-            if (!isValidCoordinate(rx, ry)) {
-                break; // Stop if out of board bounds
-            }
-            if (board[ry][rx].type == PieceType::NONE) {
-                continue; // Empty square, keep checking
-            } else if (board[ry][rx].color == attackingColor &&
-                       (board[ry][rx].type == PieceType::ROOK || board[ry][rx].type == PieceType::QUEEN)) {
-                return true; // Opponent's rook or queen can attack this square
-            } else {
-                break; // Reached a piece that blocks further horizontal/vertical movement
+        if (score > bestScore) {
+            bestScore = score;
+            if (score > alpha) {
+                alpha = score;
+                if (alpha >= beta) {
+                    break; // Beta cutoff
+                }
             }
         }
     }
+    return bestScore;
+}
 
-    // Check for attacks from opponent's kings
-    int kingX[8] = {x - 1, x - 1, x - 1, x, x, x + 1, x + 1, x + 1};
-    int kingY[8] = {y - 1, y, y + 1, y - 1, y + 1, y - 1, y, y + 1};
-    for (int i = 0; i < 8; i++) {
-        if (isValidCoordinate(kingX[i], kingY[i]) &&
-            board[kingY[i]][kingX[i]].type == PieceType::KING &&
-            board[kingY[i]][kingX[i]].color == attackingColor) {
-            return true;
+// Null-move pruning: the depth it starts at, its depth reduction and the depth from which cutoffs are verified
+const int NULL_MOVE_MIN_DEPTH = 3;
+const int NULL_MOVE_REDUCTION = 3;
+const int NULL_MOVE_VERIFY_DEPTH = 8;
+
+// Late move reductions: the depth they start at and the number of moves searched at full depth first
+const int LMR_MIN_DEPTH = 3;
+const int LMR_FULL_DEPTH_MOVES = 3;
+
+// Late move reductions by depth and move number, growing with the logarithm of both
+const int LMR_TABLE_SIZE = 64;
+int lmrTable[LMR_TABLE_SIZE][LMR_TABLE_SIZE];
+
+// Function to fill the late move reduction table
+void initializeSearch() {
+    for (int depth = 1; depth < LMR_TABLE_SIZE; depth++) {
+        for (int moveNumber = 1; moveNumber < LMR_TABLE_SIZE; moveNumber++) {
+            lmrTable[depth][moveNumber] = static_cast<int>(0.75 + log(depth) * log(moveNumber) / 2.25);
         }
     }
+}
 
-    // No attacks found
-    return false;
+// Function to check if a side has any piece other than pawns and its king, which makes zugzwang unlikely
+inline bool hasNonPawnMaterial(const Position& pos, PieceColor color) {
+    const Bitboard* own = pos.pieces[colorIndex(color)];
+    return (own[typeIndex(PieceType::QUEEN)] | own[typeIndex(PieceType::ROOK)] |
+            own[typeIndex(PieceType::BISHOP)] | own[typeIndex(PieceType::KNIGHT)]) != 0;
 }
 
-// Function to check if a move is valid for the king
-bool isValidKingMove(int startX, int startY, int endX, int endY) {
-    // Validate coordinates
-    if (!isValidCoordinate(startX, startY) || !isValidCoordinate(endX, endY)) {
-        cout << "Invalid Move. Try again." << endl;
-        return false;
+// Function to check if the last move made on a position was a null move
+inline bool lastMoveWasNull(const StateStack& states) {
+    return states.size > 0 && states.entries[states.size - 1].move.isNone();
+}
+
+// Function to search a position with negamax alpha-beta and principal variation search
+int alphaBeta(SearchWorker& worker, int alpha, int beta, int depth, int ply) {
+    if (depth <= 0) {
+        return quiescence(worker, alpha, beta, ply);
     }
 
-    // Check if moving to the same position
-    if (startX == endX && startY == endY) {
-        cout << "Invalid Move. Try again." << endl;
-        return false;
+    Position& pos = worker.pos;
+    bool pvNode = beta - alpha > 1;
+    worker.pvLength[ply] = ply;
+    if (!visitNode(worker)) {
+        return 0;
     }
 
-    // Check if the destination square is under attack
-    PieceColor color = board[startY][startX].color;
-    if (isUnderAttack(endX, endY, (color == PieceColor::WHITE) ? PieceColor::BLACK : PieceColor::WHITE)) {
-        cout << "Invalid Move. Your king is in check." << endl;
-        return false;
+    if (ply > 0 && isDraw(pos, worker.states)) {
+        return 0;
+    }
+    if (ply >= MAX_PLY - 1) {
+        return evaluate(pos, worker.states, worker.pawnTable);
     }
 
-    // Placeholder logic for valid king moves (simplified rules)
-    int dx = abs(endX - startX);
-    int dy = abs(endY - startY);
-    if ((dx == 1 || dy == 1) && (dx <= 1 && dy <= 1)) {
-        // Valid king move
-        return true;
-    } else if (dx == 2 && dy == 0 && startY == 0) {
-        // Check for castling
-        // Placeholder logic for castling
-        return true;
-    } else {
-        cout << "Invalid Move. Try again." << endl;
-        return false;
+    // A deep enough stored result can end the search of this node outside the principal variation
+    TTData ttData;
+    bool ttHit = probeTranspositionTable(transpositionTable, pos.key, ttData);
+    if (ttHit && !pvNode && ttData.depth >= depth) {
+        int ttScore = scoreFromTT(ttData.score, ply);
+        if (ttData.bound == Bound::EXACT ||
+            (ttData.bound == Bound::LOWER && ttScore >= beta) ||
+            (ttData.bound == Bound::UPPER && ttScore <= alpha)) {
+            return ttScore;
+        }
     }
-}
 
-// Function to check if a move is valid for the queen
-bool isValidQueenMove(int startX, int startY, int endX, int endY) {
-    int dx = abs(endX - startX);
-    int dy = abs(endY - startY);
-    return (dx == dy) || (startX == endX) || (startY == endY);
-}
+    // Null-move pruning: if passing the turn still fails high against a reduced search, a real move would too.
+    // Not tried in check, at PV nodes, twice in a row or with only pawns left, where zugzwang is common
+    bool inCheck = isInCheck(pos, pos.sideToMove);
+    if (!pvNode && !inCheck && depth >= NULL_MOVE_MIN_DEPTH && ply >= worker.nullMoveMinPly &&
+        !lastMoveWasNull(worker.states) && hasNonPawnMaterial(pos, pos.sideToMove) &&
+        evaluate(pos, worker.states, worker.pawnTable) >= beta) {
+        int reduction = NULL_MOVE_REDUCTION + depth / 6;
+        worker.stats.nullMoveTries++;
+        doNullMove(pos, worker.states);
+        int score = -alphaBeta(worker, -beta, -beta + 1, depth - 1 - reduction, ply + 1);
+        undoNullMove(pos, worker.states);
+        if (isStopped(worker)) {
+            return 0;
+        }
 
-// Function to check if a move is valid for the rook
-bool isValidRookMove(int startX, int startY, int endX, int endY) {
-    return (startX == endX) || (startY == endY);
-}
+        if (score >= beta) {
+            // A mate found after passing the turn is not a proven mate
+            score = min(score, MATE_BOUND - 1);
+            if (depth < NULL_MOVE_VERIFY_DEPTH || worker.nullMoveMinPly > 0) {
+                worker.stats.nullMoveCutoffs++;
+                return score;
+            }
 
-// Function to check if a move is valid for the bishop
-bool isValidBishopMove(int startX, int startY, int endX, int endY) {
-    int dx = abs(endX - startX);
-    int dy = abs(endY - startY);
-    return dx == dy;
-}
+            // Deep cutoffs are verified by a reduced search of the real moves, with null moves
+            // switched off for the first plies of it
+            worker.stats.nullMoveVerifications++;
+            worker.nullMoveMinPly = ply + 3 * (depth - reduction) / 4;
+            int verified = alphaBeta(worker, beta - 1, beta, depth - reduction, ply);
+            worker.nullMoveMinPly = 0;
+            if (isStopped(worker)) {
+                return 0;
+            }
+            if (verified >= beta) {
+                worker.stats.nullMoveCutoffs++;
+                return score;
+            }
+            worker.stats.nullMoveVerifyFails++;
+        }
+    }
 
-// Function to check if a move is valid for the knight
-bool isValidKnightMove(int startX, int startY, int endX, int endY) {
-    int dx = abs(endX - startX);
-    int dy = abs(endY - startY);
-    return ((dx == 1 && dy == 2) || (dx == 2 && dy == 1)) && (dx + dy == 3);
-}
+    MovePicker picker;
+    initMovePicker(picker, worker, ttHit ? ttData.move : Move(), ply);
+
+    int bestScore = -INFINITE_SCORE;
+    Move bestMove;
+    int originalAlpha = alpha;
+    int moveCount = 0;
+    Move quietsTried[MAX_QUIETS_TRIED];
+    int quietCount = 0;
+    Move move;
+    while (nextMove(picker, worker, move)) {
+        bool quiet = isQuiet(pos, move);
+        moveCount++;
+        doMove(pos, worker.states, move);
+        int score;
+        if (moveCount == 1) {
+            score = -alphaBeta(worker, -beta, -alpha, depth - 1, ply + 1);
+        } else {
+            // Late move reductions: quiet moves late in the ordering that do not give check are searched
+            // shallower first, and again at full depth only if they beat alpha
+            int reduction = 0;
+            if (depth >= LMR_MIN_DEPTH && moveCount > LMR_FULL_DEPTH_MOVES && quiet && !inCheck &&
+                !isInCheck(pos, pos.sideToMove)) {
+                reduction = lmrTable[min(depth, LMR_TABLE_SIZE - 1)][min(moveCount, LMR_TABLE_SIZE - 1)] - (pvNode ? 1 : 0);
+                reduction = max(0, min(reduction, depth - 2));
+            }
 
-// Function to check if a move is valid for the pawn
-bool isValidPawnMove(int startX, int startY, int endX, int endY, PieceColor color, bool enPassantAllowed) {
-    int dx = endX - startX;
-    int dy = endY - startY;
+            // Later moves are expected to fail low: prove it with a null window, re-search if they do not
+            if (reduction > 0) {
+                worker.stats.lmrReductions++;
+                score = -alphaBeta(worker, -alpha - 1, -alpha, depth - 1 - reduction, ply + 1);
+                if (score > alpha) {
+                    worker.stats.lmrResearches++;
+                    score = -alphaBeta(worker, -alpha - 1, -alpha, depth - 1, ply + 1);
+                }
+            } else {
+                score = -alphaBeta(worker, -alpha - 1, -alpha, depth - 1, ply + 1);
+            }
+            if (score > alpha && score < beta) {
+                score = -alphaBeta(worker, -beta, -alpha, depth - 1, ply + 1);
+            }
+        }
+        undoMove(pos, worker.states);
 
-    // Check direction based on piece color
-    int forwardDir = (color == PieceColor::WHITE) ? 1 : -1;
+        if (isStopped(worker)) {
+            return 0;
+        }
 
-    // Pawn moves forward by 1 square
-    if (dy == forwardDir && dx == 0 && board[endX][endY].type == PieceType::NONE) {
-        return true;
+        if (score > bestScore) {
+            bestScore = score;
+            bestMove = move;
+            if (score > alpha) {
+                alpha = score;
+                // Record the principal variation: this move followed by the child's line
+                worker.pvTable[ply][ply] = move;
+                for (int next = ply + 1; next < worker.pvLength[ply + 1]; next++) {
+                    worker.pvTable[ply][next] = worker.pvTable[ply + 1][next];
+                }
+                worker.pvLength[ply] = worker.pvLength[ply + 1];
+                if (alpha >= beta) {
+                    if (quiet) {
+                        updateQuietStats(worker, move, quietsTried, quietCount, depth, ply);
+                    }
+                    break; // Beta cutoff
+                }
+            }
+        }
+        if (quiet && quietCount < MAX_QUIETS_TRIED) {
+            quietsTried[quietCount++] = move;
+        }
     }
 
-    // Pawn moves forward by 2 squares from starting position
-    if (dy == 2 * forwardDir && dx == 0 && startY == 1 && color == PieceColor::WHITE &&
-        board[startX + forwardDir][startY].type == PieceType::NONE && board[endX][endY].type == PieceType::NONE) {
-        return true;
-    } else if (dy == 2 * forwardDir && dx == 0 && startY == 6 && color == PieceColor::BLACK &&
-               board[startX + forwardDir][startY].type == PieceType::NONE && board[endX][endY].type == PieceType::NONE) {
-        return true;
+    if (moveCount == 0) {
+        // Checkmate or stalemate
+        return inCheck ? -MATE_SCORE + ply : 0;
     }
 
-    // Pawn captures diagonally
-    if (abs(dx) == 1 && abs(dy) == 1 && board[endX][endY].type != PieceType::NONE) {
-        return true;
-    }
+    Bound bound = bestScore >= beta ? Bound::LOWER : bestScore > originalAlpha ? Bound::EXACT : Bound::UPPER;
+    storeTranspositionTable(transpositionTable, worker.ttGeneration, pos.key, depth, bound, scoreToTT(bestScore, ply), bestMove);
+    return bestScore;
+}
 
-    // En passant capture
-    if (enPassantAllowed && abs(dx) == 1 && abs(dy) == 1 && board[endX][endY].type == PieceType::NONE &&
-        board[startX][endY].type == PieceType::PAWN && board[startX][endY].moved) {
-        return true;
-    }
+// Function to add one set of search counters to another
+void addSearchStats(SearchStats& total, const SearchStats& stats) {
+    total.nullMoveTries += stats.nullMoveTries;
+    total.nullMoveCutoffs += stats.nullMoveCutoffs;
+    total.nullMoveVerifications += stats.nullMoveVerifications;
+    total.nullMoveVerifyFails += stats.nullMoveVerifyFails;
+    total.lmrReductions += stats.lmrReductions;
+    total.lmrResearches += stats.lmrResearches;
+}
 
-    return false;
+// Function to print the search counters
+void printSearchStats(const SearchStats& stats) {
+    cout << "Null move: " << stats.nullMoveTries << " tried, " << stats.nullMoveCutoffs << " cutoffs, "
+         << stats.nullMoveVerifications << " verified, " << stats.nullMoveVerifyFails << " failed verification" << endl;
+    cout << "Late move reductions: " << stats.lmrReductions << " reduced, "
+         << stats.lmrResearches << " re-searched" << endl;
+}
+
+// Function to format a score as centipawns or moves to mate
+string formatScore(int score) {
+    if (score >= MATE_BOUND) {
+        return "mate " + to_string((MATE_SCORE - score + 1) / 2);
+    }
+    if (score <= -MATE_BOUND) {
+        return "mate -" + to_string((MATE_SCORE + score) / 2);
+    }
+    return "cp " + to_string(score);
 }
 
-// Function to check if a move puts the king in check
-bool isMoveLeavesKingInCheck(int startX, int startY, int endX, int endY, PieceColor color) {
-    // Temporarily make the move
-    Piece tempPiece = board[endX][endY];
-    board[endX][endY] = board[startX][startY];
-    board[startX][startY] = {PieceType::NONE, PieceColor::NONE};
+// Depth skipping pattern of the helper threads, so that they spread over different depths
+// instead of all searching the same iteration as thread 0
+const int SKIP_SIZE[20] = {1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4, 4, 4};
+const int SKIP_PHASE[20] = {0, 1, 0, 1, 2, 3, 0, 1, 2, 3, 4, 5, 0, 1, 2, 3, 4, 5, 6, 7};
+
+// Function to run iterative deepening on one search thread
+void iterativeDeepening(SearchWorker& worker, const vector<SearchWorker*>& workers) {
+    for (int depth = 1; depth <= min(worker.limits.depth, MAX_PLY - 1); depth++) {
+        // Helper threads skip some depths, staggered by thread number
+        if (worker.threadId > 0) {
+            int i = (worker.threadId - 1) % 20;
+            if (((depth + SKIP_PHASE[i]) / SKIP_SIZE[i]) % 2 != 0) {
+                continue;
+            }
+        }
 
-    // Check if the king is under attack after the move
-    bool isCheck = isUnderAttack(board[endX][endY].type == PieceType::KING ? endX : -1,
-                                 board[endX][endY].type == PieceType::KING ? endY : -1, color);
+        int score = alphaBeta(worker, -INFINITE_SCORE, INFINITE_SCORE, depth, 0);
+        if (isStopped(worker)) {
+            break; // Results of an unfinished iteration are discarded
+        }
 
-    // Undo the move
-    board[startX][startY] = board[endX][endY];
-    board[endX][endY] = tempPiece;
+        worker.completedDepth = depth;
+        worker.bestScore = score;
+        worker.pv.assign(worker.pvTable[0], worker.pvTable[0] + worker.pvLength[0]);
+
+        int elapsed = elapsedTime(worker);
+        if (worker.verbose) {
+            uint64_t nodes = 0;
+            uint64_t pawnProbes = 0;
+            uint64_t pawnHits = 0;
+            for (const SearchWorker* w : workers) {
+                nodes += w->nodes.load(memory_order_relaxed);
+                pawnProbes += w->pawnTable.probes.load(memory_order_relaxed);
+                pawnHits += w->pawnTable.hits.load(memory_order_relaxed);
+            }
+            cout << "info depth " << depth << " score " << formatScore(score) << " nodes " << nodes
+                 << " time " << elapsed << " nps " << (elapsed > 0 ? nodes * 1000 / elapsed : 0)
+                 << " hashfull " << hashfull(transpositionTable, worker.ttGeneration)
+                 << " pawnhits " << (pawnProbes ? pawnHits * 100 / pawnProbes : 0) << "% pv";
+            for (const Move& move : worker.pv) {
+                cout << " " << convertMoveToString(move);
+            }
+            cout << endl;
+        }
 
-    return isCheck;
+        // No need to search deeper once a forced mate has been found
+        if (abs(score) >= MATE_BOUND) {
+            break;
+        }
+        if (worker.threadId == 0 && !worker.pv.empty() &&
+            !timeForNextIteration(worker.time, worker.pv[0], score, depth, elapsed)) {
+            break;
+        }
+    }
 }
 
-// Function to check if a move is valid (including special moves)
-bool isValidMove(PieceType type, int startX, int startY, int endX, int endY, PieceColor color, bool enPassantAllowed) {
-    // Validate coordinates
-    if (!isValidMove(startX, startY, endX, endY)) {
-        return false;
+// Function to take a worker from the pool, or a new one when every worker is busy
+unique_ptr<SearchWorker> acquireWorker(WorkerPool& pool) {
+    lock_guard<mutex> guard(pool.lock);
+    if (pool.idle.empty()) {
+        return unique_ptr<SearchWorker>(new SearchWorker());
     }
+    unique_ptr<SearchWorker> worker = move(pool.idle.back());
+    pool.idle.pop_back();
+    return worker;
+}
 
-    // Check if moving to the same position
-    if (startX == endX && startY == endY) {
-        return false;
-    }
+// Function to give a worker back to the pool once its search is over
+void releaseWorker(WorkerPool& pool, unique_ptr<SearchWorker> worker) {
+    lock_guard<mutex> guard(pool.lock);
+    pool.idle.push_back(move(worker));
+}
 
-    // Get the piece being moved
-    Piece& piece = board[startX][startY];
+// Function to find the best move with iterative deepening, stopping at the depth or time limit.
+// With several threads, helper threads search the same root (Lazy SMP) and fill the shared hash table.
+// Each thread starts from a copy of rootStates, whose accumulators the caller keeps up to date
+SearchResult searchBestMove(const Position& rootPos, const StateStack& rootStates, const SearchLimits& limits,
+                            bool verbose, int threadCount) {
+    SearchResult result;
+    MoveList rootMoves;
+    generateLegalMoves(rootPos, rootMoves);
+    if (rootMoves.empty()) {
+        return result;
+    }
 
-    // Check if the piece is of the correct color
-    if (piece.color != color) {
-        return false;
+    uint8_t ttGeneration = newTranspositionTableSearch(transpositionTable);
+    atomic<bool> stop(false);
+    auto startTime = chrono::steady_clock::now();
+    vector<unique_ptr<SearchWorker>> owners;
+    vector<SearchWorker*> workers;
+    for (int i = 0; i < max(1, threadCount); i++) {
+        owners.push_back(acquireWorker(workerPool));
+        SearchWorker& worker = *owners.back();
+        worker.threadId = i;
+        worker.pos = rootPos;
+        worker.states = rootStates;
+        worker.ttGeneration = ttGeneration;
+        // Start the counters and the per-search tables afresh, keeping the pawn hash and history tables
+        worker.nodes.store(0);
+        worker.pawnTable.probes.store(0);
+        worker.pawnTable.hits.store(0);
+        fill(&worker.killers[0][0], &worker.killers[0][0] + MAX_PLY * 2, Move());
+        worker.nullMoveMinPly = 0;
+        worker.stats = SearchStats();
+        worker.completedDepth = 0;
+        worker.bestScore = 0;
+        worker.pv.clear();
+        worker.limits = limits;
+        worker.startTime = startTime;
+        worker.stop = &stop;
+        worker.verbose = verbose && i == 0;
+        initializeTimeManager(worker.time, limits);
+        workers.push_back(&worker);
     }
 
-    // Check if the destination square has the same color piece
-    if (board[endX][endY].color == piece.color) {
-        return false;
+    // Helpers run until thread 0 finishes its iterations and raises the stop flag
+    vector<thread> helpers;
+    for (size_t i = 1; i < workers.size(); i++) {
+        helpers.emplace_back(iterativeDeepening, ref(*workers[i]), cref(workers));
+    }
+    iterativeDeepening(*workers[0], workers);
+    stop.store(true);
+    for (thread& helper : helpers) {
+        helper.join();
     }
 
-    // Placeholder logic for valid moves (simplified rules)
-    switch (type) {
-        case PieceType::KING:
-          /*return isValidKingMove(startX, startY, endX, endY, color) &&
-                   !isMoveLeavesKingInCheck(startX, startY, endX, endY, color);*/
-            return isValidKingMove(startX, startY, endX, endY) && 
-                    !isMoveLeavesKingInCheck(startX, startY, endX, endY, color);
-            
-        case PieceType::QUEEN:
-            return isValidQueenMove(startX, startY, endX, endY) &&
-                   !isMoveLeavesKingInCheck(startX, startY, endX, endY, color);
-        case PieceType::ROOK:
-            return isValidRookMove(startX, startY, endX, endY) &&
-                   !isMoveLeavesKingInCheck(startX, startY, endX, endY, color);
-        case PieceType::BISHOP:
-            return isValidBishopMove(startX, startY, endX, endY) &&
-                   !isMoveLeavesKingInCheck(startX, startY, endX, endY, color);
-        case PieceType::KNIGHT:
-            return isValidKnightMove(startX, startY, endX, endY) &&
-                   !isMoveLeavesKingInCheck(startX, startY, endX, endY, color);
-        case PieceType::PAWN:
-            return isValidPawnMove(startX, startY, endX, endY, color, enPassantAllowed) &&
-                   !isMoveLeavesKingInCheck(startX, startY, endX, endY, color);
-        default:
-            return false; // Invalid type
+    // Take the move of the thread that completed the deepest iteration, preferring thread 0 on ties
+    const SearchWorker* best = workers[0];
+    for (const SearchWorker* worker : workers) {
+        if (worker->completedDepth > best->completedDepth && !worker->pv.empty()) {
+            best = worker;
+        }
+        result.nodes += worker->nodes.load();
+        result.pawnProbes += worker->pawnTable.probes.load();
+        result.pawnHits += worker->pawnTable.hits.load();
+        addSearchStats(result.stats, worker->stats);
     }
+    result.depth = best->completedDepth;
+    result.score = best->bestScore;
+    result.pv = best->pv;
+    // Fall back to any legal move if not even the first iteration completed
+    result.bestMove = result.pv.empty() ? rootMoves[0] : result.pv[0];
+    for (unique_ptr<SearchWorker>& worker : owners) {
+        releaseWorker(workerPool, move(worker));
+    }
+    return result;
 }
 
-// Function to handle pawn promotion
-void promotePawn(int endX, int endY, PieceColor color) {
+// Function to ask the player which piece to promote a pawn to
+PieceType readPromotionChoice() {
     char promotionChoice;
     cout << "Pawn promotion! Choose a piece to promote to (Q, R, B, N): ";
     cin >> promotionChoice;
 
-    PieceType promotedType = PieceType::NONE;
-    switch (promotionChoice) {
-        case 'Q':
-            promotedType = PieceType::QUEEN;
-            break;
+    switch (toupper(promotionChoice)) {
         case 'R':
-            promotedType = PieceType::ROOK;
-            break;
+            return PieceType::ROOK;
         case 'B':
-            promotedType = PieceType::BISHOP;
-            break;
+            return PieceType::BISHOP;
         case 'N':
-            promotedType = PieceType::KNIGHT;
-            break;
+            return PieceType::KNIGHT;
         default:
-            promotedType = PieceType::QUEEN; // Default to queen
-            break;
+            return PieceType::QUEEN; // Default to queen
     }
-
-    board[endX][endY] = {promotedType, color};
 }
 
-// Function to handle en passant capture
-void handleEnPassant(int startX, int startY, int endX, int endY) {
-    if (board[startX][startY].type == PieceType::PAWN && abs(startX - endX) == 2) {
-        board[startX][startY].moved = true; // Set the pawn's moved flag for en passant
-    }
+// Function to set up a new game from the starting position, with the AI's clock from the time control
+void initializeGame(Game& game) {
+    initializeBoard(game.pos);
+    resetStateStack(game.pos, game.states);
+    game.history.clear();
+    game.aiTimeLeft = aiTimeControlTime;
+    game.aiMovesToGo = aiTimeControlMoves;
 }
 
-// Function to handle castling
-void handleCastling(int startX, int startY, int endX, int endY) {
-    if (board[startX][startY].type == PieceType::KING && abs(startY - endY) == 2) {
-        // Kingside castling
-        if (endY > startY) {
-            board[startX][endY - 1] = board[startX][BOARD_SIZE - 1];
-            board[startX][BOARD_SIZE - 1] = {PieceType::NONE, PieceColor::NONE};
-        }
-        // Queenside castling
-        else {
-            board[startX][endY + 1] = board[startX][0];
-            board[startX][0] = {PieceType::NONE, PieceColor::NONE};
-        }
-        board[startX][startY].moved = true; // Set the king's moved flag for castling
+// Function to make room on a game's state stack, forgetting the oldest undo information when the
+// game outgrows it and leaving room for the search
+void reserveStateStack(StateStack& states) {
+    if (states.size >= MAX_STATE_STACK - MAX_PLY) {
+        copy(states.entries + MAX_STATE_STACK / 2, states.entries + MAX_STATE_STACK, states.entries);
+        states.size -= MAX_STATE_STACK / 2;
     }
 }
 
-// Function to make a move
-bool makeMove(int startX, int startY, int endX, int endY, PieceColor color, bool& enPassantAllowed) {
-    if (!isValidMove(board[startX][startY].type, startX, startY, endX, endY, color, enPassantAllowed)) {
+// Function to make a move in a game
+bool makeMove(Game& game, int start, int end, PieceType promotion = PieceType::NONE) {
+    Position& pos = game.pos;
+    if (!isValidMove(pos, start, end, pos.sideToMove)) {
         cout << "Invalid move. Try again." << endl;
         return false;
     }
 
-    // Handle special moves
-    handleEnPassant(startX, startY, endX, endY);
-    handleCastling(startX, startY, endX, endY);
-
-    // Check for pawn promotion
-    if (board[startX][startY].type == PieceType::PAWN && (endX == 0 || endX == BOARD_SIZE - 1)) {
-        promotePawn(endX, endY, color);
+    // Ask for the promotion piece if the caller did not choose one
+    if (promotion == PieceType::NONE && pieceAt(pos, start).type() == PieceType::PAWN &&
+        (rankOf(end) == 0 || rankOf(end) == BOARD_SIZE - 1)) {
+        promotion = readPromotionChoice();
     }
 
-    // Make the move
-    board[endX][endY] = board[startX][startY];
-    board[startX][startY] = {PieceType::NONE, PieceColor::NONE};
-    board[endX][endY].moved = true;
-
+    reserveStateStack(game.states);
+    Move move = createMove(pos, start, end, promotion);
+    doMove(pos, game.states, move);
+    game.history.push_back(move);
     return true;
 }
 
-// Function to check if a player is in checkmate
-bool isCheckmate(PieceColor color) {
-    // Check if the king is in check
-    for (int row = 0; row < BOARD_SIZE; row++) {
-        for (int col = 0; col < BOARD_SIZE; col++) {
-            if (board[row][col].type == PieceType::KING && board[row][col].color == color) {
-                if (isUnderAttack(row, col, color)) {
-                    // Check if the king has any valid moves left
-                    for (int dx = -1; dx <= 1; dx++) {
-                        for (int dy = -1; dy <= 1; dy++) {
-                            int newX = row + dx;
-                            int newY = col + dy;
-                            if (isValidMove(PieceType::KING, row, col, newX, newY, color, false) &&
-                                !isMoveLeavesKingInCheck(row, col, newX, newY, color)) {
-                                return false; // King can escape check
-                            }
-                        }
-                    }
-
-                    // Check if any other piece can capture or block the attacker
-                    for (int i = 0; i < BOARD_SIZE; i++) {
-                        for (int j = 0; j < BOARD_SIZE; j++) {
-                            if (board[i][j].color == color && isValidMove(board[i][j].type, i, j, row, col, color, false) &&
-                                !isMoveLeavesKingInCheck(i, j, row, col, color)) {
-                                return false; // Piece can capture/block the attacker
-                            }
-                        }
-                    }
-
-                    return true; // King is in checkmate
-                }
-            }
+// Function to take back the last moves made in a game, returns false if there are not enough to undo
+bool takeBack(Game& game, int plies) {
+    if (static_cast<int>(game.history.size()) < plies) {
+        return false;
+    }
+    game.history.resize(game.history.size() - plies);
+    if (game.states.size >= plies) {
+        for (int i = 0; i < plies; i++) {
+            undoMove(game.pos, game.states);
         }
+        return true;
     }
 
-    return false; // King is not in checkmate
+    // The undo information of these moves was forgotten: replay the game from the start instead
+    initializeBoard(game.pos);
+    resetStateStack(game.pos, game.states);
+    for (const Move& move : game.history) {
+        reserveStateStack(game.states);
+        doMove(game.pos, game.states, move);
+    }
+    return true;
 }
 
-// Function to check if the game is in stalemate
-bool isStalemate(PieceColor color) {
-    // Check if the king is not in check but has no valid moves left
-    for (int row = 0; row < BOARD_SIZE; row++) {
-        for (int col = 0; col < BOARD_SIZE; col++) {
-            if (board[row][col].color == color) {
-                for (int i = 0; i < BOARD_SIZE; i++) {
-                    for (int j = 0; j < BOARD_SIZE; j++) {
-                        if (isValidMove(board[row][col].type, row, col, i, j, color, false) &&
-                            !isMoveLeavesKingInCheck(row, col, i, j, color)) {
-                            return false; // Player has at least one valid move
-                        }
-                    }
-                }
-            }
-        }
-    }
+// Function to check if the side to move has at least one valid move
+bool hasValidMove(const Position& pos) {
+    MoveList moves;
+    generateLegalMoves(pos, moves);
+    return !moves.empty();
+}
+
+// Function to check if the side to move is checkmated
+bool isCheckmate(const Position& pos) {
+    // The king must be in check with no move that escapes it
+    return isInCheck(pos, pos.sideToMove) && !hasValidMove(pos);
+}
 
-    return true; // Stalemate
+// Function to check if the side to move is stalemated
+bool isStalemate(const Position& pos) {
+    // The king must not be in check but has no valid moves left
+    return !isInCheck(pos, pos.sideToMove) && !hasValidMove(pos);
 }
 
-// Function to handle the player's turn
-void playerTurn(PieceColor color, bool& enPassantAllowed) {
+// Function to handle the player's turn, returns false if the input ran out
+bool playerTurn(Game& game) {
     while (true) {
         string move;
-        cout << (color == PieceColor::WHITE ? "White's move: " : "Black's move: ");
-        cin >> move;
+        cout << (game.pos.sideToMove == PieceColor::WHITE ? "White's move: " : "Black's move: ");
+        if (!(cin >> move)) {
+            return false;
+        }
+
+        // Take back the player's last move and the reply to it
+        if (move == "undo") {
+            if (takeBack(game, 2)) {
+                displayBoard(game.pos);
+            } else {
+                cout << "Nothing to undo." << endl;
+            }
+            continue;
+        }
 
         // Check if the move is in algebraic notation
         if (move.size() != 4) {
-            cout << "Invalid move format. Use algebraic notation (e.g., e2e4)." << endl;
+            cout << "Invalid move format. Use algebraic notation (e.g., e2e4) or undo." << endl;
             continue;
         }
 
-        // Convert algebraic notation to coordinates
-        pair<int, int> start = convertAlgebraicToCoordinates(move.substr(0, 2));
-        pair<int, int> end = convertAlgebraicToCoordinates(move.substr(2));
+        // Convert algebraic notation to squares
+        int start = convertAlgebraicToSquare(move.substr(0, 2));
+        int end = convertAlgebraicToSquare(move.substr(2));
 
-        if (!isValidCoordinate(start.first, start.second) || !isValidCoordinate(end.first, end.second)) {
+        if (start == NO_SQUARE || end == NO_SQUARE) {
             cout << "Invalid coordinates. Try again." << endl;
             continue;
         }
 
-        if (makeMove(start.first, start.second, end.first, end.second, color, enPassantAllowed)) {
-            break;
+        if (makeMove(game, start, end)) {
+            return true;
         }
     }
 }
 
-// Function to simulate a basic AI player's turn
-void aiTurn(PieceColor color, bool& enPassantAllowed) {
-    // Placeholder logic for AI's move (random valid move)
-    vector<pair<pair<int, int>, pair<int, int>>> validMoves;
-    for (int i = 0; i < BOARD_SIZE; i++) {
-        for (int j = 0; j < BOARD_SIZE; j++) {
-            if (board[i][j].color == color) {
-                for (int x = 0; x < BOARD_SIZE; x++) {
-                    for (int y = 0; y < BOARD_SIZE; y++) {
-                        if (isValidMove(board[i][j].type, i, j, x, y, color, enPassantAllowed) &&
-                            !isMoveLeavesKingInCheck(i, j, x, y, color)) {
-                            validMoves.push_back({{i, j}, {x, y}});
-                        }
-                    }
-                }
+// Function to play the AI player's turn with the best move the search finds
+void aiTurn(Game& game) {
+    SearchLimits limits;
+    limits.depth = aiDepth;
+    if (game.aiTimeLeft > 0) {
+        limits.timeLeft = game.aiTimeLeft;
+        limits.increment = aiIncrement;
+        limits.movesToGo = game.aiMovesToGo;
+    } else {
+        limits.moveTime = aiMoveTime;
+    }
+    auto startTime = chrono::steady_clock::now();
+    SearchResult result = searchBestMove(game.pos, game.states, limits, false, searchThreads);
+
+    // Charge the AI's clock for the move, then add the increment and any new time control
+    if (game.aiTimeLeft > 0) {
+        game.aiTimeLeft -= static_cast<int>(chrono::duration_cast<chrono::milliseconds>(
+            chrono::steady_clock::now() - startTime).count());
+        game.aiTimeLeft = max(1, game.aiTimeLeft + aiIncrement);
+        if (aiTimeControlMoves > 0 && --game.aiMovesToGo == 0) {
+            game.aiTimeLeft += aiTimeControlTime;
+            game.aiMovesToGo = aiTimeControlMoves;
+        }
+    }
+
+    if (!result.bestMove.isNone()) {
+        cout << "AI plays " << convertMoveToString(result.bestMove) << " (depth " << result.depth
+             << ", score " << formatScore(result.score) << ")" << endl;
+        makeMove(game, result.bestMove.from(), result.bestMove.to(), result.bestMove.promotion());
+    }
+}
+
+// Function to count the leaf nodes of the legal move tree to a given depth
+uint64_t perft(Position& pos, StateStack& states, int depth) {
+    MoveList moves;
+    generateLegalMoves(pos, moves);
+
+    // The moves at the last ply are counted in bulk instead of being made
+    if (depth <= 1) {
+        return depth == 1 ? moves.size() : 1;
+    }
+
+    uint64_t nodes = 0;
+    for (const Move& move : moves) {
+        doMove(pos, states, move);
+        nodes += perft(pos, states, depth - 1);
+        undoMove(pos, states);
+    }
+    return nodes;
+}
+
+// Function to run perft from a position, printing the count below each root move (divide) and the speed
+// The second-ply subtrees are shared out to the worker threads, each searching its own copy of the position
+void runPerft(const Position& rootPos, int depth, int threadCount) {
+    auto startTime = chrono::steady_clock::now();
+
+    // One task per (root move, reply) pair; a root move without replies becomes a task of its own
+    struct PerftTask {
+        int rootIndex;
+        Move reply;
+        bool hasReply;
+        uint64_t nodes;
+    };
+    Position pos = rootPos;
+    unique_ptr<StateStack> states(new StateStack());
+    MoveList rootMoves;
+    vector<PerftTask> tasks;
+    generateLegalMoves(pos, rootMoves);
+    for (int i = 0; i < rootMoves.size(); i++) {
+        MoveList replies;
+        if (depth > 1) {
+            doMove(pos, *states, rootMoves[i]);
+            generateLegalMoves(pos, replies);
+            undoMove(pos, *states);
+        }
+        if (replies.empty()) {
+            tasks.push_back({i, Move(), false, 0});
+        }
+        for (const Move& reply : replies) {
+            tasks.push_back({i, reply, true, 0});
+        }
+    }
+
+    atomic<size_t> nextTask(0);
+    auto worker = [&]() {
+        Position threadPos = rootPos;
+        unique_ptr<StateStack> threadStates(new StateStack());
+        for (size_t t = nextTask++; t < tasks.size(); t = nextTask++) {
+            PerftTask& task = tasks[t];
+            if (!task.hasReply) {
+                task.nodes = (depth > 1) ? 0 : 1;
+                continue;
             }
+            doMove(threadPos, *threadStates, rootMoves[task.rootIndex]);
+            doMove(threadPos, *threadStates, task.reply);
+            task.nodes = perft(threadPos, *threadStates, depth - 2);
+            undoMove(threadPos, *threadStates);
+            undoMove(threadPos, *threadStates);
         }
+    };
+
+    vector<thread> workers;
+    for (int i = 1; i < threadCount; i++) {
+        workers.emplace_back(worker);
+    }
+    worker();
+    for (thread& t : workers) {
+        t.join();
+    }
+
+    // Sum the tasks in generation order so the output does not depend on thread timing
+    vector<uint64_t> rootNodes(rootMoves.size(), 0);
+    for (const PerftTask& task : tasks) {
+        rootNodes[task.rootIndex] += task.nodes;
+    }
+    uint64_t total = 0;
+    for (int i = 0; i < rootMoves.size(); i++) {
+        cout << convertMoveToString(rootMoves[i]) << ": " << rootNodes[i] << endl;
+        total += rootNodes[i];
+    }
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - startTime).count();
+    cout << endl;
+    cout << "Nodes searched: " << total << endl;
+    cout << "Threads: " << threadCount << endl;
+    cout << "Time: " << static_cast<long long>(seconds * 1000) << " ms" << endl;
+    cout << "Nodes per second: " << static_cast<long long>(seconds > 0 ? total / seconds : 0) << endl;
+}
+
+// Function to handle the perft command line: perft <depth> [fen] [--threads N] [--pext on|off]
+int perftCommand(int argc, char* argv[]) {
+    if (argc < 3 || atoi(argv[2]) < 1) {
+        cout << "Usage: " << argv[0] << " perft <depth> [fen] [--threads N] [--pext on|off]" << endl;
+        return 1;
+    }
+    int depth = atoi(argv[2]);
+    int threadCount = 1;
+
+    // The FEN may be passed as one quoted argument or as separate fields
+    string fen;
+    for (int i = 3; i < argc; i++) {
+        if (string(argv[i]) == "--threads" && i + 1 < argc) {
+            threadCount = max(1, atoi(argv[++i]));
+            continue;
+        }
+        if (string(argv[i]) == "--pext" && i + 1 < argc) {
+            i++; // Applied by main
+            continue;
+        }
+        fen += (fen.empty() ? "" : " ") + string(argv[i]);
+    }
+
+    Position pos;
+    if (!setFromFEN(pos, fen.empty() ? START_FEN : fen)) {
+        cout << "Invalid FEN: " << fen << endl;
+        return 1;
+    }
+    runPerft(pos, depth, threadCount);
+    return 0;
+}
+
+// Function to handle the search command line:
+// search [fen] [--depth N] [--movetime ms] [--time ms] [--inc ms] [--movestogo N] [--hash MB] [--threads N] [--nnue file] [--pext on|off]
+int searchCommand(int argc, char* argv[]) {
+    SearchLimits limits;
+    string fen;
+    for (int i = 2; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--depth" && i + 1 < argc) {
+            limits.depth = max(1, atoi(argv[++i]));
+        } else if (arg == "--movetime" && i + 1 < argc) {
+            limits.moveTime = max(1, atoi(argv[++i]));
+        } else if (arg == "--time" && i + 1 < argc) {
+            limits.timeLeft = max(1, atoi(argv[++i]));
+        } else if (arg == "--inc" && i + 1 < argc) {
+            limits.increment = max(0, atoi(argv[++i]));
+        } else if (arg == "--movestogo" && i + 1 < argc) {
+            limits.movesToGo = max(0, atoi(argv[++i]));
+        } else if ((arg == "--hash" || arg == "--threads" || arg == "--nnue" || arg == "--pext") && i + 1 < argc) {
+            i++; // Applied by main
+        } else {
+            fen += (fen.empty() ? "" : " ") + arg;
+        }
+    }
+    if (limits.depth == MAX_PLY - 1 && limits.moveTime == 0 && limits.timeLeft == 0) {
+        limits.moveTime = DEFAULT_MOVE_TIME_MS;
+    }
+
+    Position pos;
+    if (!setFromFEN(pos, fen.empty() ? START_FEN : fen)) {
+        cout << "Invalid FEN: " << fen << endl;
+        return 1;
+    }
+    unique_ptr<StateStack> states(new StateStack());
+    resetStateStack(pos, *states);
+    SearchResult result = searchBestMove(pos, *states, limits, true, searchThreads);
+    printSearchStats(result.stats);
+    cout << "bestmove " << (result.bestMove.isNone() ? "(none)" : convertMoveToString(result.bestMove)) << endl;
+    return 0;
+}
+
+// Function to handle the see command line: see [fen] [--pext on|off]
+// Prints the static exchange value of every capture and promotion in the position
+int seeCommand(int argc, char* argv[]) {
+    string fen;
+    for (int i = 2; i < argc; i++) {
+        if (string(argv[i]) == "--pext" && i + 1 < argc) {
+            i++; // Applied by main
+            continue;
+        }
+        fen += (fen.empty() ? "" : " ") + string(argv[i]);
+    }
+
+    Position pos;
+    if (!setFromFEN(pos, fen.empty() ? START_FEN : fen)) {
+        cout << "Invalid FEN: " << fen << endl;
+        return 1;
+    }
+    MoveList moves;
+    generateLegalMoves(pos, moves, GenType::CAPTURES);
+    for (const Move& move : moves) {
+        cout << convertMoveToString(move) << ": " << staticExchange(pos, move) << endl;
+    }
+    return 0;
+}
+
+// Function to handle the eval command line: eval [fen] [--nnue file] [--pext on|off]
+// Prints every term of the static evaluation of the position
+int evalCommand(int argc, char* argv[]) {
+    string fen;
+    for (int i = 2; i < argc; i++) {
+        if ((string(argv[i]) == "--nnue" || string(argv[i]) == "--pext") && i + 1 < argc) {
+            i++; // Applied by main
+            continue;
+        }
+        fen += (fen.empty() ? "" : " ") + string(argv[i]);
     }
 
-    if (!validMoves.empty()) {
-        int randomIndex = rand() % validMoves.size();
-        auto move = validMoves[randomIndex];
-        makeMove(move.first.first, move.first.second, move.second.first, move.second.second, color, enPassantAllowed);
+    Position pos;
+    if (!setFromFEN(pos, fen.empty() ? START_FEN : fen)) {
+        cout << "Invalid FEN: " << fen << endl;
+        return 1;
     }
+    traceEvaluation(pos);
+    return 0;
+}
+
+// Fixed positions searched by the bench command
+const string BENCH_FENS[] = {
+    START_FEN,
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+    "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+    "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+    "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+    "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+    "r1bq1rk1/pp2bppp/2n1pn2/3p4/2PP4/2N1PN2/PP1BBPPP/R2QK2R w KQ - 0 8",
+    "2r3k1/pp3ppp/4p3/3pP3/3P1P2/P1R3P1/1P4KP/8 b - - 0 30",
+    "8/8/4k3/3p4/3P4/4K3/8/8 w - - 0 1",
+    "6k1/5ppp/8/8/8/8/5PPP/3R2K1 w - - 0 1"
+};
+
+// Function to handle the bench command line: bench [depth] [--nnue file] [--pext on|off]
+// Searches every bench position to a fixed depth on one thread and reports the total nodes and speed
+int benchCommand(int argc, char* argv[]) {
+    SearchLimits limits;
+    limits.depth = (argc >= 3 && argv[2][0] != '-') ? max(1, atoi(argv[2])) : 7;
+
+    Position pos;
+    unique_ptr<StateStack> states(new StateStack());
+    uint64_t totalNodes = 0;
+    uint64_t pawnProbes = 0;
+    uint64_t pawnHits = 0;
+    SearchStats stats;
+    auto startTime = chrono::steady_clock::now();
+    for (const string& fen : BENCH_FENS) {
+        setFromFEN(pos, fen);
+        resetStateStack(pos, *states);
+        clearTranspositionTable(transpositionTable);
+        SearchResult result = searchBestMove(pos, *states, limits, false, 1);
+        cout << fen << ": " << result.nodes << " nodes, bestmove " << convertMoveToString(result.bestMove) << endl;
+        totalNodes += result.nodes;
+        pawnProbes += result.pawnProbes;
+        pawnHits += result.pawnHits;
+        addSearchStats(stats, result.stats);
+    }
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - startTime).count();
+    cout << endl;
+    cout << "Nodes searched: " << totalNodes << endl;
+    cout << "Time: " << static_cast<long long>(seconds * 1000) << " ms" << endl;
+    cout << "Nodes per second: " << static_cast<long long>(seconds > 0 ? totalNodes / seconds : 0) << endl;
+    cout << "Pawn hash hit rate: " << (pawnProbes ? pawnHits * 100 / pawnProbes : 0) << "%" << endl;
+    printSearchStats(stats);
+    return 0;
 }
 
 // Function to play a game of chess
 void playChessGame() {
-    initializeBoard();
-    displayBoard();
+    Game game;
+    initializeGame(game);
+    displayBoard(game.pos);
     bool gameOver = false;
     bool whiteTurn = true;
-    bool enPassantAllowed = false;
 
     while (!gameOver) {
         if (whiteTurn) {
-            playerTurn(PieceColor::WHITE, enPassantAllowed);
+            if (!playerTurn(game)) {
+                break;
+            }
         } else {
-            aiTurn(PieceColor::BLACK, enPassantAllowed);
+            aiTurn(game);
         }
 
-        displayBoard();
-        if (isCheckmate(whiteTurn ? PieceColor::WHITE : PieceColor::BLACK)) {
+        displayBoard(game.pos);
+        // The side that has to move next is the one that may be mated or stalemated
+        if (isCheckmate(game.pos)) {
             gameOver = true;
-            cout << (whiteTurn ? "Black" : "White") << " wins by checkmate!" << endl;
-        } else if (isStalemate(whiteTurn ? PieceColor::WHITE : PieceColor::BLACK)) {
+            cout << (whiteTurn ? "White" : "Black") << " wins by checkmate!" << endl;
+        } else if (isStalemate(game.pos)) {
             gameOver = true;
             cout << "Stalemate!" << endl;
         }
@@ -598,7 +3427,72 @@ void playChessGame() {
     }
 }
 
-int main() {
+int main(int argc, char* argv[]) {
+    // --pext on|off picks the sliding attack indexing, which has to be known before the tables are built
+    for (int i = 1; i + 1 < argc; i++) {
+        if (string(argv[i]) == "--pext") {
+            usePext = string(argv[++i]) == "on";
+        }
+    }
+#ifndef HAS_PEXT_SUPPORT
+    if (usePext) {
+        cout << "PEXT needs a build for BMI2 CPUs (-mbmi2), using magic bitboards" << endl;
+        usePext = false;
+    }
+#endif
+    initializeSlidingAttacks();
+    initializeZobrist();
+    initializeEvaluation();
+    initializeSearch();
+
+    if (argc >= 2 && string(argv[1]) == "perft") {
+        return perftCommand(argc, argv);
+    }
+    if (argc >= 2 && string(argv[1]) == "see") {
+        return seeCommand(argc, argv);
+    }
+
+    // Game options: --hash <MB> sets the AI's transposition table size, --threads <N> its number
+    // of search threads, and --movetime <ms> and --depth <N> limit how long it thinks.
+    // --time <ms> [--inc <ms>] [--movestogo <N>] give it a game clock instead of a fixed move time,
+    // and --nnue <file> makes it evaluate with the network in that file
+    size_t hashMegabytes = DEFAULT_HASH_MB;
+    for (int i = 1; i + 1 < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--hash") {
+            hashMegabytes = max(1, atoi(argv[++i]));
+        } else if (arg == "--movetime") {
+            aiMoveTime = max(1, atoi(argv[++i]));
+        } else if (arg == "--depth") {
+            aiDepth = max(1, min(MAX_PLY - 1, atoi(argv[++i])));
+        } else if (arg == "--threads") {
+            searchThreads = max(1, atoi(argv[++i]));
+        } else if (arg == "--time") {
+            aiTimeControlTime = max(1, atoi(argv[++i]));
+        } else if (arg == "--inc") {
+            aiIncrement = max(0, atoi(argv[++i]));
+        } else if (arg == "--movestogo") {
+            aiTimeControlMoves = max(0, atoi(argv[++i]));
+        } else if (arg == "--nnue") {
+            string path = argv[++i];
+            if (!loadNetwork(path)) {
+                cout << "Could not load the network " << path << ", using the standard evaluation" << endl;
+            }
+        }
+    }
+    resizeTranspositionTable(transpositionTable, hashMegabytes);
+
+    if (argc >= 2 && string(argv[1]) == "eval") {
+        return evalCommand(argc, argv);
+    }
+
+    if (argc >= 2 && string(argv[1]) == "search") {
+        return searchCommand(argc, argv);
+    }
+    if (argc >= 2 && string(argv[1]) == "bench") {
+        return benchCommand(argc, argv);
+    }
+
     playChessGame();
     return 0;
 }